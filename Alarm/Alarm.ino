@@ -19,6 +19,11 @@
  */
 #include <Config.h>
 #include <Shiftreg.h>
+#include <Event.h>
+#include <Journal.h>
+#include <Stats.h>
+#include <Timer.h>
+#include <Sched.h>
 #include <Sensor.h>
 #include <Control.h>
 #include <stdio.h>
@@ -26,7 +31,18 @@
 const  int ledPin = 13; // on-board status LED
 
 SensorManager *mgr;	// sensor collection manager
+OutCascade *output;	// indicator output cascade
 ControlManager *ctrls;  // control collection manager
+#ifdef EVENT_LOG
+EventLog *events;	// sensor/zone events, waiting to be reported
+#endif
+#ifdef JOURNAL
+Journal *journal;	// event history, in the EEPROM
+#endif
+#ifdef SCHEDULE
+Scheduler *sched;	// runs the main loop tasks
+#endif
+unsigned char prevArm;	// zone armed bits last read from the controls
 int debug = 0;          // enables serial port logging
 
 // glue to enable printf to write to the serial port
@@ -55,6 +71,71 @@ void doDebug( char c ) {
 	case 'l':	// one minue lamp test
 		mgr->lampTest(true);
 		return;
+
+#ifdef LED_BAM
+	case 'b':	// toggle night (dimmed) LED brightness
+		mgr->dim( !mgr->dimmed );
+		return;
+
+#endif
+	case 's':	// idle samples, and sensors touched in the last one
+		printf("S=%lu/%lu T=%u\n", mgr->idle, mgr->scans, mgr->touched);
+		return;
+
+	case 'z':	// each zone: sensors, open, triggered, fibrillating, and which are open
+		SensorManager::ZoneSummary s;
+		for( int z = 1; mgr->zoneSummary( z, &s ); z++ ) {
+			printf("Z=%d %c S=%u O=%u T=%u F=%u", z,
+				(mgr->zoneArmed & (1 << z)) ? 'A' : 'd',
+				s.sensors, s.open, s.triggered, s.fibrillating);
+#ifdef ZONE_DELAYS
+			// exiting, entering (and seconds left), or entry delay ran out
+			if ((mgr->exiting | mgr->entering) & (1 << z))
+				printf(" %c%lu", (mgr->exiting & (1 << z)) ? 'X' : 'E',
+					(mgr->delayLeft( z ) + 999) / 1000);
+			else if (mgr->alarmed & (1 << z))
+				printf(" !");
+#endif
+			for( int i = mgr->nextOpen( z, -1 ); i >= 0; i = mgr->nextOpen( z, i ) )
+				printf(" %d", i);
+			putchar('\n');
+		}
+		return;
+
+#ifdef LATENCY
+	case 'h':	// input to relay latency, and sample period, histograms
+		mgr->latency.print('L');
+		mgr->period.print('P');
+		return;
+
+#endif
+#ifdef PROFILE
+	case 'p':	// time in each loop phase since the last report
+		mgr->profile->print();
+		return;
+
+#endif
+#ifdef SCHEDULE
+	case 't':	// each task's runs, overruns, and times since the last report
+		sched->print();
+		sched->reset();
+		return;
+
+#endif
+	case 'w':	// output cascade writes vs skipped writes
+		printf("W=%lu/%lu\n", output->writes, output->writes + output->skips);
+		return;
+
+#ifdef EVENT_LOG
+	case 'e':	// events waiting, and events dropped
+		printf("E=%u D=%lu\n", events->count(), events->dropped);
+		return;
+#endif
+#ifdef JOURNAL
+	case 'j':	// journaled events, and records written since boot
+		printf("J=%d W=%lu\n", journal->count, journal->writes);
+		return;
+#endif
 	}
   
   // log the debug level (strings take up data space)
@@ -70,6 +151,100 @@ void doDebug( char c ) {
 }
 #endif
 
+#ifdef SCHEDULE
+/*
+ * The main loop is a table of tasks, each run at its own rate.
+ * A task that starts more than its deadline after it was due is
+ * an overrun, and the t debug command shows how they are doing.
+ */
+
+#ifdef GOVERNOR
+/**
+ * scan fast while the system is armed or sensors are changing,
+ * and slowly (sleeping in between) when it is disarmed and quiet
+ */
+void govern() {
+	static unsigned long lastBusy;	// when we last had reason to hurry
+	static unsigned period = SCAN_FAST;
+
+	unsigned long now = millis();
+	if ((prevArm & 1) || mgr->touched != 0)
+		lastBusy = now;
+	unsigned p = (now - lastBusy < SCAN_QUIET) ? SCAN_FAST : SCAN_SLOW;
+	if (p != period) {
+		sched->retime( 'S', p );
+		sched->retime( 'L', p );
+		sched->retime( 'E', p );
+		period = p;
+	}
+}
+#endif
+
+/**
+ * initially the indicators are set by the lamp tester,
+ * but after that completes, they are set based on the
+ * status of their respective sensors.
+ */
+void scanTask() {
+	if (!mgr->lampTest(false))
+		mgr->sample();  // sample does all the work
+#ifdef GOVERNOR
+	govern();
+#endif
+}
+
+/**
+ * update the LEDs (and the relays and zone delays)
+ */
+void ledTask() {
+	mgr->update();
+}
+
+/**
+ * maintain an idle pattern on the board LED
+ *   (2hz when armed, 1hz when not armed)
+ */
+void flashTask() {
+	int flash = (millis() / (prevArm ? 500 : 1000)) & 1;
+	digitalWrite(ledPin, flash ? HIGH : LOW );
+}
+
+#ifdef DEBUG_CMD
+/**
+ * check for (unlikely) debug console input
+ */
+void consoleTask() {
+	if (Serial.available())
+		doDebug( Serial.read() );
+}
+#endif
+
+#ifdef LED_ISR
+#define	LED_MS	1	// the interrupt runs the duty cycle
+#else
+#define	LED_MS	0	// update runs the duty cycle, every pass
+#endif
+#ifdef ADC_ISR
+#define	CTRL_MS	10	// the ADC interrupt keeps the controls current
+#else
+#define	CTRL_MS	100	// analog reads are slow
+#endif
+
+Task tasks[] = {
+	// run		period	deadline (ms)
+	{ scanTask,	1,	1,	'S' },	// sensors (debounce delays are in scans)
+	{ ledTask,	LED_MS,	1,	'L' },	// LED frames, relays and zone delays
+#ifdef EVENT_LOG
+	{ reportEvent,	1,	10,	'E' },	// report (and journal) an event
+#endif
+	{ checkArms,	CTRL_MS, 50,	'A' },	// arm controls
+	{ flashTask,	50,	50,	'F' },	// activity LED
+#ifdef DEBUG_CMD
+	{ consoleTask,	100,	100,	'C' },	// debug commands
+#endif
+};
+#endif
+
 /**
  * configure the pins and initialize the resource managers.
  */
@@ -90,18 +265,81 @@ void setup() {
 	Config *cfg = new Config();
 
 	// configure the shift register cascades
-	InShifter *input = new InShifter( cfg->input->num_regs,
-				cfg->input->data, cfg->input->clock, cfg->input->latch );
-	OutShifter *output = new OutShifter( cfg->output->num_regs,
-				cfg->output->data, cfg->output->clock, cfg->output->latch );
+#ifdef STATIC_SHIFT
+	static InCascade inCascade;	// sized and wired at compile time
+	static OutCascade outCascade;
+	InCascade *input = &inCascade;
+	output = &outCascade;
+#else
+	InCascade *input = new InShifter( cfg->input->num_regs,
+				cfg->input->data, cfg->input->clock, cfg->input->latch,
+				cfg->input->mode, cfg->input->cascades );
+	output = new OutShifter( cfg->output->num_regs,
+				cfg->output->data, cfg->output->clock, cfg->output->latch,
+				cfg->output->mode );
+#endif
 
 	// allocate a sensor manager for the known sensors
+#ifdef EVENT_LOG
+	events = new EventLog( EVENT_LOG );
+	mgr = new SensorManager( cfg, input, output, events );
+#else
 	mgr = new SensorManager( cfg, input, output );
+#endif
+
+#ifdef JOURNAL
+	// pick up where we were when we lost power
+	journal = new Journal( JOURNAL );
+	mgr->restore( journal );
+	events->put( E_BOOT, 255, 0, 1, millis() );
+#endif
+	prevArm = mgr->zoneArmed;
 
         // allocate a control manager for the defined input controls
         ctrls = new ControlManager( cfg );
+
+#ifdef SCHEDULE
+	sched = new Scheduler( tasks, sizeof tasks / sizeof tasks[0] );
+#endif
 }
 
+/**
+ * check for changes in zone armedness
+ *	bit 0:		system arm/reset
+ *	bits 1-7:	zone arms
+ */
+void checkArms() {
+#ifdef PROFILE
+	unsigned long t = micros();
+#endif
+	unsigned char armed = ctrls->read();
+#ifdef PROFILE
+	mgr->profile->add( SensorManager::p_ctrl, micros() - t );
+#endif
+	unsigned char difs = armed ^ prevArm;
+	if (difs != 0) {
+		for( int i = 0; i < 8; i++ ) {
+			char mask = 1 << i;
+			if ((difs & mask) != 0) {
+				bool on = (armed & mask);
+				mgr->arm(i, on);
+			}
+		}
+	} 
+	prevArm = armed;
+}
+
+#ifdef SCHEDULE
+/** arduino main loop
+ *  run whichever tasks are due
+ */
+void loop() {
+	sched->run( millis() );
+#ifdef GOVERNOR
+	sched->idle();	// sleep until the next one is due
+#endif
+}
+#else
 /** arduino main loop
  *  on start-up we run lamp tests
  *  after that
@@ -111,7 +349,6 @@ void setup() {
  *      (2hz when armed, 1hz when not armed)
  */
 void loop() {
-	static unsigned char prevArm = 0;	// we keep track of system armed status
 	static int prevFlash = 0;	// we keep track of the progress pattern
 
 	/*
@@ -124,6 +361,10 @@ void loop() {
 
 	mgr->update();          // update the LEDs
 
+#ifdef EVENT_LOG
+	reportEvent();		// report (at most) one event per loop
+#endif
+
 	/*
 	 * when we change the activity LED once or twice a second
 	 * and this is also a good time to check the armed and debug
@@ -140,26 +381,99 @@ void loop() {
 				doDebug( Serial.read() );
 			}
 #endif
-			// check for changes in zone armedness
-			//	bit 0:		system arm/reset
-			//	bits 1-7:	zone arms
-			unsigned char armed = ctrls->read();
-			unsigned char difs = armed ^ prevArm;
-			if (difs != 0) {
-				for( int i = 0; i < 8; i++ ) {
-					char mask = 1 << i;
-					if ((difs & mask) != 0) {
-						bool on = (armed & mask);
-						mgr->arm(i, on);
-					}
-				}
-			} 
-                        prevArm = armed;
+			checkArms();
 		}
 	}
 	
 	prevFlash = flash;
 }
+#endif
+
+#ifdef EVENT_LOG
+/**
+ * take the oldest event off the ring and report it
+ *
+ *  using putchar because strings take up data space
+ */
+void reportEvent() {
+#ifdef JOURNAL
+	// events wait in the ring until the journal can take them
+	journal->poll();
+	if (!journal->ready())
+		return;
+#endif
+	Event e;
+	if (!events->get( &e ))
+		return;
+#ifdef JOURNAL
+#ifdef DEFIB
+	// a fibrillating sensor's chatter would soon wear out the EEPROM
+	journal->append( &e, e.what == E_SENSOR && mgr->fibrillating( e.sensor ) );
+#else
+	journal->append( &e );
+#endif
+#endif
+
+#ifdef DEBUG_EVT
+	if (debug <= 1)
+		return;
+
+#ifdef EVENT_BINARY
+	// a few bytes, for host/EventStat.cpp to decode
+	static EventEncoder encoder;
+	unsigned char frame[EVENT_FRAME];
+	int n = encoder.encode( &e, frame );
+	for( int i = 0; i < n; i++ )
+		Serial.write( frame[i] );
+#else
+	logTime( e.time );
+	switch( e.what ) {
+	    case E_SENSOR:
+		putchar(e.state ? '-' : '!');
+		putchar(' ');
+		putchar('S');
+		putchar('=');
+		putchar('0' + e.sensor/10);
+		putchar('0' + e.sensor%10);
+		break;
+
+	    case E_ARM:
+		putchar(e.state ? 'A' : 'd');
+		putchar(' ');
+		putchar('Z');
+		putchar('=');
+		putchar('0' + e.zone%10);
+		break;
+
+	    case E_TRIGGER:
+		putchar('*');
+		putchar(' ');
+		putchar('S');
+		putchar('=');
+		putchar('0' + e.sensor/10);
+		putchar('0' + e.sensor%10);
+		break;
+
+	    case E_TEST:
+		putchar(e.state ? 'T' : 'R');
+		putchar(e.state ? 'E' : 'U');
+		putchar(e.state ? 'S' : 'N');
+		if (e.state)
+			putchar('T');
+		break;
+
+	    case E_BOOT:
+		putchar('B');
+		putchar('O');
+		putchar('O');
+		putchar('T');
+		break;
+	}
+	putchar('\n');
+#endif
+#endif
+}
+#endif
 
 /**
  * print out a log line time header
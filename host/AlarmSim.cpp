@@ -0,0 +1,178 @@
+/**
+ * Run the Alarm sketch against the simulated board, and report
+ * what each loop() costs in bus cycles, pin toggles and latches.
+ *
+ * (see README.md for how to build it)
+ *
+ * usage: alarmsim [-n loops] [-w ms] [-a] [-t input:loops] [-r seed:pct]
+ *		   [-o input:loop] [-c char] [-e image] [-v] [-x]
+ *	-n	number of loops to measure (default 1000)
+ *	-w	simulated ms to run before measuring (default 10000,
+ *		which gets us past the start-up lamp test)
+ *	-a	assert all of the control inputs (armed)
+ *	-t	toggle a sensor input every so many loops
+ *	-r	each loop, flip a random sensor input with probability pct%
+ *	-o	set a sensor input high (open) at that loop
+ *	-c	send a console command once warm-up completes
+ *	-e	start with the EEPROM image in this file (if there is one),
+ *		and save the EEPROM there when done (a power cycle)
+ *	-v	report per-indicator duty cycles
+ *	-x	trace the relays and latched indicators after each loop
+ *		(for comparing the behavior of two versions of the code)
+ */
+#include <Arduino.h>
+#include <unistd.h>
+#include "Sim.h"
+
+// prototypes the Arduino IDE would have generated for the sketch
+void setup();
+void loop();
+void logTime( unsigned long mstime );
+void doDebug( char c );
+void reportEvent();
+void checkArms();
+
+#include "../Alarm/Alarm.ino"
+
+int main( int argc, char **argv ) {
+	long loops = 1000;
+	long warmup = 10000;
+	bool armed = false;
+	int toggleInput = -1;
+	long togglePeriod = 0;
+	int command = -1;
+	bool verbose = false;
+	bool trace = false;
+	unsigned seed = 0;
+	int flipPct = 0;
+	int openInput = -1;
+	long openLoop = 0;
+	const char *image = 0;
+
+	int c;
+	while( (c = getopt( argc, argv, "n:w:at:r:o:c:e:vx" )) != -1 ) {
+		switch( c ) {
+		    case 'n':
+			loops = atol( optarg );
+			break;
+		    case 'w':
+			warmup = atol( optarg );
+			break;
+		    case 'a':
+			armed = true;
+			break;
+		    case 't':
+			if (sscanf( optarg, "%d:%ld", &toggleInput, &togglePeriod ) != 2 ||
+			    togglePeriod <= 0) {
+				fprintf( stderr, "bad toggle: %s\n", optarg );
+				return 1;
+			}
+			break;
+		    case 'r':
+			if (sscanf( optarg, "%u:%d", &seed, &flipPct ) != 2) {
+				fprintf( stderr, "bad random: %s\n", optarg );
+				return 1;
+			}
+			srand( seed );
+			break;
+		    case 'o':
+			if (sscanf( optarg, "%d:%ld", &openInput, &openLoop ) != 2) {
+				fprintf( stderr, "bad open: %s\n", optarg );
+				return 1;
+			}
+			break;
+		    case 'x':
+			trace = true;
+			break;
+		    case 'c':
+			command = optarg[0];
+			break;
+		    case 'e':
+			image = optarg;
+			break;
+		    case 'v':
+			verbose = true;
+			break;
+		    default:
+			fprintf( stderr, "usage: %s [-n loops] [-w ms] [-a] "
+				"[-t input:loops] [-r seed:pct] [-o input:loop] [-c char] [-e image] "
+				"[-v] [-x]\n",
+				argv[0] );
+			return 1;
+		}
+	}
+
+	// controls are low asserted; everything starts out closed
+	for( int p = A0; p <= A5; p++ )
+		simAnalog( p, armed ? 0 : 1023 );
+
+	if (image)
+		simEepromLoad( image );
+	setup();
+	while( millis() < (unsigned long) warmup )
+		loop();
+	if (command >= 0)
+		simSerial( command );
+
+	SimStats before = simStats;
+	unsigned long writes = output->writes;
+	unsigned long skips = output->skips;
+	unsigned long long onBefore[OUT_REGS * 8];
+	for( int i = 0; i < OUT_REGS * 8; i++ )
+		onBefore[i] = simOnTime( i );
+
+	bool value = false;
+	for( long n = 0; n < loops; n++ ) {
+		if (toggleInput >= 0 && n % togglePeriod == 0) {
+			value = !value;
+			simInput( toggleInput, value );
+		}
+		if (n == openLoop && openInput >= 0)
+			simInput( openInput, true );
+		if (flipPct > 0 && rand() % 100 < flipPct) {
+			static bool inputs[IN_REGS * IN_CASCADES * 8];
+			int i = rand() % (IN_REGS * IN_CASCADES * 8);
+			inputs[i] = !inputs[i];
+			simInput( i, inputs[i] );
+		}
+		loop();
+
+		if (trace) {
+			// relay pins, then every latch of the output cascade
+			static Config simCfg;
+			printf( "%ld: ", n );
+			for( int z = 1; z <= simCfg.sensors->numZones(); z++ )
+				putchar( '0' + simPin( simCfg.sensors->zonePin( z ) ) );
+			printf( " %08lx\n", simStats.latchHash );
+		}
+	}
+
+	double cycles = simStats.cycles - before.cycles;
+	printf( "loops: %ld, simulated time %.1fms\n",
+		loops, cycles / (1000.0 * CYCLES_PER_US) );
+	printf( "per loop: cycles=%.0f, bus cycles=%.0f, toggles=%.1f, "
+		"in latches=%.2f, out latches=%.2f\n",
+		cycles / loops,
+		(double) (simStats.busCycles - before.busCycles) / loops,
+		(double) (simStats.toggles - before.toggles) / loops,
+		(double) (simStats.inLatches - before.inLatches) / loops,
+		(double) (simStats.outLatches - before.outLatches) / loops );
+	printf( "output writes: %lu, skipped: %lu\n",
+		output->writes - writes, output->skips - skips );
+	if (simStats.sleepCycles > before.sleepCycles)
+		printf( "asleep: %.1f%%\n",
+			100 * (simStats.sleepCycles - before.sleepCycles) / cycles );
+
+	if (verbose) {
+		for( int i = 0; i < OUT_REGS * 8; i++ ) {
+			double duty = (simOnTime( i ) - onBefore[i]) / cycles;
+			printf( "%2d:%5.1f%%%s", i, 100 * duty, (i % 8 == 7) ? "\n" : "  " );
+		}
+	}
+
+	if (image && !simEepromSave( image )) {
+		perror( image );
+		return 1;
+	}
+	return 0;
+}
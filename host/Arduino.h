@@ -0,0 +1,122 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+/**
+ * Host (Linux) stand-in for the parts of the Arduino API that
+ * the Alarm libraries use, so that they can be run against a
+ * simulated board (see Sim.h) rather than the real one.
+ *
+ * Every pin operation is charged an estimated number of AVR
+ * cycles (see Sim.cpp), and millis()/micros() are derived from
+ * the resulting simulated clock, so runs are deterministic.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define	HIGH		1
+#define	LOW		0
+#define	INPUT		0
+#define	OUTPUT		1
+#define	LSBFIRST	0
+#define	MSBFIRST	1
+
+// an Uno: digital 0-7 are PORTD, 8-13 are PORTB, A0-A5 are PORTC
+#define	NUM_PINS	20
+#define	A0	14
+#define	A1	15
+#define	A2	16
+#define	A3	17
+#define	A4	18
+#define	A5	19
+
+void pinMode( uint8_t pin, uint8_t mode );
+void digitalWrite( uint8_t pin, uint8_t value );
+int digitalRead( uint8_t pin );
+int analogRead( uint8_t pin );
+void shiftOut( uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t value );
+unsigned long millis();
+unsigned long micros();
+void delayMicroseconds( unsigned int us );
+
+/*
+ * interrupts: the only asynchronous events the simulator has are
+ * Timer2 in CTC mode (which the LED multiplexer uses) and the ADC.
+ * Their interrupts are taken between pin operations, whenever the
+ * I bit in SREG is set and the next one is due.
+ */
+extern uint8_t SREG;
+inline void cli() { SREG &= ~0x80; }
+inline void sei() { SREG |= 0x80; }
+#define	noInterrupts()	cli()
+#define	interrupts()	sei()
+
+extern uint8_t TCCR2A, TCCR2B, OCR2A, TIMSK2, TCNT2;
+#define	WGM21	1	// TCCR2A: CTC mode
+#define	CS20	0	// TCCR2B: clock select bits
+#define	CS21	1
+#define	CS22	2
+#define	OCIE2A	1	// TIMSK2: compare match A interrupt enable
+
+/*
+ * the ADC, auto-triggered by Timer0 overflows (every 1024us),
+ * with an interrupt on each conversion
+ */
+extern uint8_t ADMUX, ADCSRA, ADCSRB;
+extern uint16_t ADC;		// conversion result
+#define	REFS0	6	// ADMUX: AVcc reference
+#define	ADEN	7	// ADCSRA: enable
+#define	ADSC	6	// ADCSRA: start conversion
+#define	ADATE	5	// ADCSRA: auto trigger
+#define	ADIE	3	// ADCSRA: conversion complete interrupt enable
+#define	ADPS0	0	// ADCSRA: prescaler bits
+#define	ADPS1	1
+#define	ADPS2	2
+#define	ADTS2	2	// ADCSRB: trigger on Timer0 overflow (ADTS = 100)
+
+#define	ISR(vector)	void vector()
+void TIMER2_COMPA_vect() __attribute__((weak));
+void ADC_vect() __attribute__((weak));
+
+/**
+ * a simulated port register.  Reads and read-modify-writes
+ * are charged AVR cycles, and writes drive the simulated pins
+ * (just as digitalWrite does).
+ */
+class SimPort {
+  public:
+    uint8_t port;	// 0=D, 1=B, 2=C
+    bool input;		// PINx rather than PORTx
+
+    operator uint8_t() const volatile;
+    void operator|=( uint8_t bits ) volatile;
+    void operator&=( uint8_t bits ) volatile;
+    void operator=( uint8_t value ) volatile;
+};
+#define	PORT_REG	volatile SimPort
+
+uint8_t digitalPinToPort( uint8_t pin );
+uint8_t digitalPinToBitMask( uint8_t pin );
+volatile SimPort *portOutputRegister( uint8_t port );
+volatile SimPort *portInputRegister( uint8_t port );
+
+/*
+ * the serial port just goes to stdout
+ */
+class HardwareSerial {
+  public:
+    void begin( long ) {}
+    int available();
+    int read();
+    size_t write( uint8_t c ) { return fputc( c, stdout ) == EOF ? 0 : 1; }
+};
+extern HardwareSerial Serial;
+
+// avr-libc stdio glue used by Alarm.ino
+#define	_FDEV_SETUP_WRITE	0
+#define	fdev_setup_stream( stream, put, get, rwflag )
+#endif
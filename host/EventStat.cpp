@@ -0,0 +1,157 @@
+/**
+ * Decode a captured stream of binary event frames (EVENT_BINARY)
+ * and report what happened: per-sensor and per-zone transition
+ * counts, how long each sensor was open, and a timeline of power
+ * ups, arms and triggers.
+ *
+ * (see README.md for how to build it)
+ *
+ * usage: eventstat [-e] [file]
+ *	-e	also list every event
+ *	file	captured serial stream (default standard input);
+ *		anything that is not a valid frame is skipped
+ */
+#include <Arduino.h>
+#include <Event.h>
+#include <unistd.h>
+
+#define	MAX_SENSORS	256
+#define	MAX_ZONES	8
+
+struct SensorStats {
+	unsigned long changes;		// transitions seen
+	unsigned long opens;		// transitions to open
+	unsigned long triggers;		// times it triggered its zone
+	unsigned long long openMs;	// total time open
+	unsigned long longest;		// longest time open
+	unsigned long since;		// when it opened
+	bool open;			// is currently open
+	int zone;			// zone it reported
+};
+
+struct ZoneStats {
+	unsigned long changes;		// sensor transitions in the zone
+	unsigned long arms;		// times armed
+};
+
+static SensorStats sensors[MAX_SENSORS];
+static ZoneStats zones[MAX_ZONES];
+
+/**
+ * print a log line time header (as Alarm.ino logTime does)
+ */
+static void stamp( unsigned long ms ) {
+	printf( "%02lu:%02lu:%02lu.%03lu ", (ms / 3600000) % 24,
+		(ms / 60000) % 60, (ms / 1000) % 60, ms % 1000 );
+}
+
+int main( int argc, char **argv ) {
+	bool list = false;
+
+	int c;
+	while( (c = getopt( argc, argv, "e" )) != -1 ) {
+		switch( c ) {
+		    case 'e':
+			list = true;
+			break;
+		    default:
+			fprintf( stderr, "usage: %s [-e] [file]\n", argv[0] );
+			return 1;
+		}
+	}
+
+	FILE *in = stdin;
+	if (optind < argc && (in = fopen( argv[optind], "rb" )) == 0) {
+		perror( argv[optind] );
+		return 1;
+	}
+
+	EventDecoder decoder;
+	Event e;
+	unsigned long now = 0;
+	printf( "timeline:\n" );
+	while( (c = getc( in )) != EOF ) {
+		if (!decoder.feed( c, &e ))
+			continue;
+		now = e.time;
+		if (list) {
+			stamp( e.time );
+			printf( "what=%d sensor=%d zone=%d state=%d\n",
+				e.what, e.sensor, e.zone, e.state );
+		}
+
+		switch( e.what ) {
+		    case E_SENSOR: {
+			SensorStats *s = &sensors[e.sensor];
+			ZoneStats *z = &zones[e.zone];
+			s->changes++;
+			s->zone = e.zone;
+			z->changes++;
+			if (!e.state && !s->open) {
+				s->open = true;
+				s->opens++;
+				s->since = e.time;
+			} else if (e.state && s->open) {
+				unsigned long t = e.time - s->since;
+				s->open = false;
+				s->openMs += t;
+				if (t > s->longest)
+					s->longest = t;
+			}
+			break;
+		    }
+
+		    case E_TRIGGER:
+			sensors[e.sensor].triggers++;
+			stamp( e.time );
+			printf( "TRIGGER S=%02d Z=%d\n", e.sensor, e.zone );
+			break;
+
+		    case E_BOOT:
+			stamp( e.time );
+			printf( "power on\n" );
+			break;
+
+		    case E_ARM:
+			if (e.state)
+				zones[e.zone].arms++;
+			stamp( e.time );
+			if (e.zone == 0)
+				printf( "%s\n", e.state ? "ARMED" : "disarmed" );
+			else
+				printf( "zone %d %s\n", e.zone, e.state ? "enabled" : "disabled" );
+			break;
+
+		    case E_TEST:
+			stamp( e.time );
+			printf( "%s\n", e.state ? "lamp test" : "running" );
+			break;
+		}
+	}
+
+	printf( "\nframes: %lu, bad frames: %lu%s\n", decoder.frames, decoder.errors,
+		decoder.timed ? "" : " (no absolute time seen)" );
+
+	printf( "\nsensor zone changes  opens  trips     open ms  longest ms\n" );
+	for( int i = 0; i < MAX_SENSORS; i++ ) {
+		SensorStats *s = &sensors[i];
+		if (s->changes == 0 && s->triggers == 0)
+			continue;
+		// sensors still open are counted up to the last event
+		unsigned long long open = s->openMs;
+		unsigned long longest = s->longest;
+		if (s->open) {
+			open += now - s->since;
+			if (now - s->since > longest)
+				longest = now - s->since;
+		}
+		printf( "%6d %4d %7lu %6lu %6lu %11llu %11lu%s\n", i, s->zone, s->changes,
+			s->opens, s->triggers, open, longest, s->open ? " (open)" : "" );
+	}
+
+	printf( "\nzone changes   arms\n" );
+	for( int z = 0; z < MAX_ZONES; z++ )
+		if (zones[z].changes || zones[z].arms)
+			printf( "%4d %7lu %6lu\n", z, zones[z].changes, zones[z].arms );
+	return 0;
+}
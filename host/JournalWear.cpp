@@ -0,0 +1,255 @@
+/**
+ * Run the EEPROM Journal against the simulated EEPROM, and report
+ * how many times each byte is written per event, and so how long
+ * the EEPROM (good for 100,000 writes per byte) would last at a
+ * given event rate.  Along the way, it checks that a new Journal
+ * finds the newest record, even after a write torn by a power
+ * failure.
+ *
+ * (see README.md for how to build it)
+ *
+ * With -f, one more sensor fibrillates all the while, and a model of
+ * its defibrillation token bucket decides which of its changes are
+ * chatter (and so not journaled); the synthetic events then include
+ * arms and triggers, which must always be.
+ *
+ * usage: journalwear [-r events/day] [-n events] [-s seed]
+ *		      [-f changes/s] [capture]
+ *	-r	event rate (default: that of the capture, or 200/day)
+ *	-n	events to append (default 100000), not counting chatter
+ *	-s	random seed for the synthetic events and the tears
+ *	-f	change rate of the fibrillating sensor
+ *	capture	binary event frames (EVENT_BINARY) to replay, over
+ *		and over, rather than synthetic sensor changes
+ */
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include <Config.h>
+#include <Event.h>
+#include <Journal.h>
+#include <unistd.h>
+#include "Sim.h"
+
+#define	ENDURANCE	100000	// writes per EEPROM byte
+#define	CHECK_EVERY	997	// events between recovery checks
+#define	MAX_REPLAY	100000	// events kept from a capture
+
+#define	FIB_SENSOR	63	// the fibrillating sensor (and its zone)
+#define	FIB_ZONE	3
+#define	FIB_TRIGGERS	20	// tokens to fibrillate (MAX_TRIGGERS in Config.cpp)
+#define	FIB_LEAK	5000	// ms per token leaked (MIN_INTERVAL in Config.cpp)
+#define	FIB_FULL	31	// a full bucket (FIB_MAX in Sensor.h)
+
+static Event replay[MAX_REPLAY];
+
+/**
+ * let the EEPROM finish whatever the journal has queued
+ */
+static void drain( Journal *j ) {
+	while( !j->ready() ) {
+		simStats.cycles += 3300 * CYCLES_PER_US;
+		j->poll();
+	}
+}
+
+/**
+ * @return do two events match (as far as the journal records them)
+ */
+static bool same( const Event *a, const Event *b ) {
+	return a->what == b->what && a->sensor == b->sensor &&
+		a->zone == (b->zone & EF_ZONE) && a->state == (b->state != 0) &&
+		a->time == b->time;
+}
+
+int main( int argc, char **argv ) {
+	double rate = 0;
+	double fib = 0;
+	long events = 100000;
+	unsigned seed = 1;
+
+	int c;
+	while( (c = getopt( argc, argv, "r:n:s:f:" )) != -1 ) {
+		switch( c ) {
+		    case 'r':
+			rate = atof( optarg );
+			break;
+		    case 'n':
+			events = atol( optarg );
+			break;
+		    case 's':
+			seed = atoi( optarg );
+			break;
+		    case 'f':
+			fib = atof( optarg );
+			break;
+		    default:
+			fprintf( stderr, "usage: %s [-r events/day] [-n events] "
+				"[-s seed] [-f changes/s] [capture]\n", argv[0] );
+			return 1;
+		}
+	}
+	srand( seed );
+
+	// the (journaled) events of a capture, and their rate
+	int replays = 0;
+	if (optind < argc) {
+		FILE *in = fopen( argv[optind], "rb" );
+		if (in == 0) {
+			perror( argv[optind] );
+			return 1;
+		}
+		EventDecoder decoder;
+		Event e;
+		while( (c = getc( in )) != EOF && replays < MAX_REPLAY )
+			if (decoder.feed( c, &e ) && e.what != E_TEST)
+				replay[replays++] = e;
+		fclose( in );
+		if (replays < 2) {
+			fprintf( stderr, "%s: not enough events\n", argv[optind] );
+			return 1;
+		}
+		double days = (replay[replays-1].time - replay[0].time) / 86400000.0;
+		printf( "capture: %d events in %.1f minutes", replays, days * 1440 );
+		if (days > 0)
+			printf( " (%.0f/day)", replays / days );
+		putchar( '\n' );
+		if (rate == 0 && days > 0)
+			rate = replays / days;
+	}
+	if (rate <= 0)
+		rate = 200;
+
+	Journal *journal = new Journal( JOURNAL );
+	Event last = Event();
+	bool any = false;
+	long checks = 0, failures = 0, tears = 0;
+	unsigned long time = 0;
+
+	// the fibrillating sensor: its next change, and its token bucket
+	unsigned long nextFib = 0, nextLeak = 0;
+	unsigned long fibGap = (fib > 0 && fib < 1000) ? 1000 / fib : 1;
+	int tokens = 0;
+	long chatter = 0, skipped = 0;
+
+	unsigned long gap = (unsigned long) (2 * 86400000.0 / rate);
+	unsigned long due = 1 + rand() % gap;	// time of the next other event
+	for( long n = 0, queued = 0; n < events; ) {
+		Event e;
+		bool fibbing = false;
+		if (fib > 0 && nextFib < due) {
+			time = nextFib;
+			nextFib += fibGap;
+			e.what = E_SENSOR;
+			e.sensor = FIB_SENSOR;
+			e.zone = FIB_ZONE;
+			e.state = chatter++ & 1;
+
+			// each change adds a token, and one leaks every FIB_LEAK
+			while( tokens > 0 && nextLeak <= time ) {
+				tokens--;
+				nextLeak += FIB_LEAK;
+			}
+			if (tokens == 0)
+				nextLeak = time + FIB_LEAK;
+			if (tokens < FIB_FULL)
+				tokens++;
+			fibbing = tokens >= FIB_TRIGGERS;
+		} else {
+			if (replays > 0) {
+				e = replay[n % replays];
+			} else {
+				e.what = (fib > 0 && n % 8 == 3) ? E_ARM :
+					 (fib > 0 && n % 8 == 7) ? E_TRIGGER : E_SENSOR;
+				e.sensor = (e.what == E_ARM) ? 255 : rand() % 32;
+				e.zone = 1 + rand() % 4;
+				e.state = (e.what == E_TRIGGER) ? 1 : n & 1;
+			}
+			time = due;
+			due += 1 + rand() % gap;
+			n++;
+		}
+		e.time = (uint32_t) time;	// millis() wraps every 49 days
+
+		// the fibrillating sensor's chatter (and only that) is skipped
+		journal->append( &e, fibbing );
+		if (journal->ready()) {
+			if (!fibbing && e.what != E_TEST) {
+				fprintf( stderr, "event %ld (cause %d) not journaled\n",
+					n, e.what );
+				failures++;
+			}
+			skipped++;
+			continue;
+		} else if (fibbing) {
+			fprintf( stderr, "chatter of sensor %d journaled\n", e.sensor );
+			failures++;
+		}
+		if (queued++ % CHECK_EVERY != CHECK_EVERY - 1) {
+			drain( journal );
+			last = e;
+			any = true;
+			continue;
+		}
+
+		/*
+		 * lose power part way through writing this record: a new
+		 * journal should find the previous record as the newest
+		 * (or this one, if the bytes left to write were unchanged)
+		 */
+		int bytes = 1 + rand() % (JOURNAL_REC - 1);
+		for( int i = 0; i < bytes; i++ ) {
+			simStats.cycles += 3300 * CYCLES_PER_US;
+			journal->poll();
+		}
+		Journal *check = new Journal( JOURNAL );
+		Event newest;
+		tears++;
+		if (any && (!check->read( 0, &newest ) ||
+			    !(same( &newest, &last ) || same( &newest, &e )))) {
+			fprintf( stderr, "tear after %d bytes of event %ld: "
+				"newest is neither it nor the previous event\n", bytes, n );
+			failures++;
+		}
+		delete check;
+
+		// and when it completes, the record should be the newest
+		drain( journal );
+		last = e;
+		any = true;
+		check = new Journal( JOURNAL );
+		checks++;
+		if (!check->read( 0, &newest ) || !same( &newest, &e ) ||
+		    check->count != journal->count) {
+			fprintf( stderr, "event %ld: newest record not found\n", n );
+			failures++;
+		}
+		delete check;
+	}
+
+	// the most worn byte determines the lifetime
+	unsigned long most = 0;
+	for( int a = 0; a < JOURNAL; a++ )
+		if (simEepromWrites( a ) > most)
+			most = simEepromWrites( a );
+	long records = events + chatter - skipped;
+	double perEvent = (double) most / records;
+
+	printf( "journal: %d bytes, %d records\n", JOURNAL, JOURNAL / JOURNAL_REC );
+	printf( "events: %ld, bytes written: %lu (%.2f per event)\n", records,
+		simStats.eepromWrites, (double) simStats.eepromWrites / records );
+	printf( "most writes to one byte: %lu (%.4f per event)\n", most, perEvent );
+	printf( "recovery checks: %ld, torn writes: %ld, failures: %ld\n",
+		checks, tears, failures );
+	if (fib > 0) {
+		// the rate the journal sees, rather than what the sensors do
+		printf( "fibrillating sensor: %ld changes, %ld journaled "
+			"(journaling all would last %.2f years)\n",
+			chatter, chatter - skipped,
+			ENDURANCE / (perEvent * (rate + fib * 86400) * 365) );
+		rate = records / (time / 86400000.0);
+	}
+	printf( "at %.0f events/day: journal lasts %.0f years, "
+		"a fixed record %.1f years\n", rate,
+		ENDURANCE / (perEvent * rate * 365), ENDURANCE / (rate * 365.0) );
+	return failures ? 1 : 0;
+}
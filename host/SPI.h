@@ -0,0 +1,35 @@
+#ifndef SPI_H
+#define SPI_H
+/*
+ * the simulated SPI peripheral (see Sim.cpp): a mode 0 master on
+ * the Uno's MOSI, MISO and SCK pins, which drives and samples the
+ * simulated cascades a bit at a time, at the configured clock rate
+ */
+#include <Arduino.h>
+
+#define	MOSI	11
+#define	MISO	12
+#define	SCK	13
+#define	SS	10
+
+#define	SPI_MODE0	0
+
+class SPISettings {
+  public:
+    SPISettings( unsigned long hz, uint8_t order, uint8_t mode ) :
+	clock( hz ), bitOrder( order ), dataMode( mode ) {}
+
+    unsigned long clock;	// SCK rate (Hz)
+    uint8_t bitOrder;		// MSBFIRST or LSBFIRST
+    uint8_t dataMode;		// (only SPI_MODE0 is simulated)
+};
+
+class SPIClass {
+  public:
+    void begin();
+    void beginTransaction( SPISettings settings );
+    uint8_t transfer( uint8_t data );
+    void endTransaction() {}
+};
+extern SPIClass SPI;
+#endif
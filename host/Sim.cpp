@@ -0,0 +1,509 @@
+/**
+ * Simulated Arduino pin API and shift register cascades.
+ *
+ * The cycle costs below are estimates for a 16MHz AVR and the
+ * stock Arduino core (digitalWrite/digitalRead look up the pin's
+ * port, mask and timer in PROGMEM and save/restore SREG).  They 
+ * are not exact, but they are deterministic, which is what we
+ * need to compare one version of the code with another.
+ */
+#include <Arduino.h>
+#include <Config.h>
+#include <avr/eeprom.h>
+#include <avr/sleep.h>
+#include <SPI.h>
+#include "Sim.h"
+
+#define	C_PINMODE	60	// pinMode
+#define	C_WRITE		56	// digitalWrite
+#define	C_READ		52	// digitalRead
+#define	C_SHIFTBIT	12	// shiftOut per-bit loop overhead
+#define	C_PORT_RMW	5	// ld/or/st through a pointer
+#define	C_PORT_READ	3	// ld through a pointer
+#define	C_ANALOG	1712	// 13 ADC clocks at 125KHz + overhead
+#define	C_CLOCK		30	// millis/micros
+#define	C_ISR		40	// interrupt entry, register saves, reti
+#define	C_EEREAD	8	// EEPROM byte read (when it is not busy)
+#define	C_EEWRITE	52800	// EEPROM byte erase+write (3.3ms)
+#define	C_TIMER0	16384	// Timer0 (millis) overflow period
+#define	C_SPIBYTE	17	// SPDR write, SPIF poll loop, SPDR read
+
+uint8_t SREG = 0x80;		// the core enables interrupts before setup
+uint8_t TCCR2A, TCCR2B, OCR2A, TIMSK2, TCNT2;
+uint8_t ADMUX, ADCSRA, ADCSRB;
+uint16_t ADC;
+HardwareSerial Serial;
+SPIClass SPI;
+SimStats simStats;
+
+static uint8_t pins[NUM_PINS];		// current pin levels
+static int analogs[NUM_PINS];		// analog input levels
+static int serialIn = -1;		// pending console character
+static bool spiOn;			// SPI owns MOSI and SCK
+static SPISettings spiSet( 4000000, MSBFIRST, SPI_MODE0 );
+
+/*
+ * the input cascade(s): a 74C165 loads its parallel inputs
+ * while the latch is low, and shifts towards the data pin on
+ * each rising clock edge.  Bit 0 is what is on the data pin.
+ */
+#define	IN_BITS	(IN_REGS * 8)
+static bool inputs[IN_CASCADES][IN_BITS];	// parallel inputs
+static bool inShift[IN_CASCADES][IN_BITS];	// shift registers
+
+/*
+ * the output cascade: a 74HC595 shifts the data pin in on
+ * each rising clock edge, and copies the shift register to
+ * its outputs on each rising latch edge.  Bit 0 is the last
+ * bit shifted in.
+ */
+#define	OUT_BITS	(OUT_REGS * 8)
+static bool outShift[OUT_BITS];		// shift register
+static bool outLatch[OUT_BITS];		// latched outputs
+static unsigned long long onTime[OUT_BITS];	// cycles latched on
+static unsigned long long lastLatch;	// time of last latch
+
+static bool isBusPin( int pin ) {
+	return (pin >= IN_DATA && pin < IN_DATA + IN_CASCADES) ||
+		pin == IN_CLOCK || pin == IN_LATCH ||
+		pin == OUT_DATA || pin == OUT_CLOCK || pin == OUT_LATCH;
+}
+
+/*
+ * Timer2: if its compare match interrupt is enabled, take it
+ * for each match that has passed (unless interrupts are off,
+ * in which case it stays pending until they are turned on)
+ */
+static unsigned long long timerLast;	// time of last compare match
+static bool inInterrupt;		// running the ISR
+
+/**
+ * @return cycles between Timer2 compare matches (0 if no interrupts)
+ */
+static unsigned timer2Period() {
+	static const unsigned prescale[8] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+	unsigned p = prescale[TCCR2B & 7];
+	if (p == 0 || !(TCCR2A & (1 << WGM21)) || !(TIMSK2 & (1 << OCIE2A)) ||
+	    !TIMER2_COMPA_vect)
+		return( 0 );
+	return( (OCR2A + 1) * p );
+}
+
+static void timer2() {
+	unsigned p = timer2Period();
+	if (p == 0) {
+		timerLast = simStats.cycles;
+		return;
+	}
+	while( !inInterrupt && (SREG & 0x80) &&
+	       simStats.cycles - timerLast >= p ) {
+		timerLast += p;
+		inInterrupt = true;
+		SREG &= ~0x80;
+		simStats.cycles += C_ISR;
+		simStats.interrupts++;
+		TIMER2_COMPA_vect();
+		SREG |= 0x80;
+		inInterrupt = false;
+	}
+}
+
+/*
+ * the ADC, if its interrupt is enabled and it is auto-triggered
+ * by Timer0 overflows (every C_TIMER0 cycles): convert the level
+ * on the ADMUX channel, and take the interrupt
+ */
+static unsigned long long adcLast;	// time of last conversion
+
+static void adc() {
+	if (!(ADCSRA & (1 << ADEN)) || !(ADCSRA & (1 << ADIE)) ||
+	    !(ADCSRA & (1 << ADATE)) || (ADCSRB & 7) != (1 << ADTS2) || !ADC_vect) {
+		adcLast = simStats.cycles - simStats.cycles % C_TIMER0;
+		return;
+	}
+	while( !inInterrupt && (SREG & 0x80) &&
+	       simStats.cycles - adcLast >= C_TIMER0 ) {
+		adcLast += C_TIMER0;
+		ADC = analogs[A0 + (ADMUX & 7)];
+		inInterrupt = true;
+		SREG &= ~0x80;
+		simStats.cycles += C_ISR;
+		simStats.interrupts++;
+		ADC_vect();
+		SREG |= 0x80;
+		inInterrupt = false;
+	}
+}
+
+/*
+ * take whatever interrupts are due
+ */
+static void pending() {
+	timer2();
+	adc();
+}
+
+static void charge( int pin, unsigned cycles ) {
+	simStats.cycles += cycles;
+	if (isBusPin( pin ))
+		simStats.busCycles += cycles;
+	pending();
+}
+
+/*
+ * account for the time each output has been on
+ */
+static void accrue() {
+	for( int i = 0; i < OUT_BITS; i++ )
+		if (outLatch[i])
+			onTime[i] += simStats.cycles - lastLatch;
+	lastLatch = simStats.cycles;
+}
+
+/*
+ * a pin has been driven to a new level: let the chips react
+ */
+static void drive( int pin, int level ) {
+	int old = pins[pin];
+	pins[pin] = level ? HIGH : LOW;
+	if (pins[pin] == old)
+		return;
+
+	simStats.pinToggles[pin]++;
+	if (isBusPin( pin ))
+		simStats.toggles++;
+
+	bool rising = (pins[pin] == HIGH);
+	if (pin == OUT_CLOCK && rising) {
+		for( int i = OUT_BITS - 1; i > 0; i-- )
+			outShift[i] = outShift[i-1];
+		outShift[0] = pins[OUT_DATA];
+	}
+	if (pin == OUT_LATCH && rising) {
+		accrue();
+		for( int i = 0; i < OUT_BITS; i++ ) {
+			outLatch[i] = outShift[i];
+			simStats.latchHash = (simStats.latchHash ^ outLatch[i]) * 16777619;
+		}
+		simStats.outLatches++;
+	}
+	if (pin == IN_LATCH && !rising) {
+		for( int c = 0; c < IN_CASCADES; c++ )
+			for( int i = 0; i < IN_BITS; i++ )
+				inShift[c][i] = inputs[c][i];
+		simStats.inLatches++;
+	}
+	if (pin == IN_CLOCK && rising && pins[IN_LATCH] == HIGH) {
+		for( int c = 0; c < IN_CASCADES; c++ ) {
+			for( int i = 0; i < IN_BITS - 1; i++ )
+				inShift[c][i] = inShift[c][i+1];
+			inShift[c][IN_BITS - 1] = 0;	// serial in is grounded
+		}
+	}
+}
+
+/*
+ * the level on a pin, including those driven by the cascades
+ */
+static int level( int pin ) {
+	if (pin >= IN_DATA && pin < IN_DATA + IN_CASCADES)
+		return inShift[pin - IN_DATA][0] ? HIGH : LOW;
+	return pins[pin];
+}
+
+void pinMode( uint8_t pin, uint8_t ) {
+	charge( pin, C_PINMODE );
+}
+
+void digitalWrite( uint8_t pin, uint8_t value ) {
+	charge( pin, C_WRITE );
+	if (spiOn && (pin == MOSI || pin == SCK))
+		return;		// the SPI overrides the port
+	drive( pin, value );
+}
+
+int digitalRead( uint8_t pin ) {
+	charge( pin, C_READ );
+	return level( pin );
+}
+
+int analogRead( uint8_t pin ) {
+	charge( pin, C_ANALOG );
+	return analogs[pin];
+}
+
+void shiftOut( uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t value ) {
+	for( int i = 0; i < 8; i++ ) {
+		int bit = (bitOrder == LSBFIRST) ? (value >> i) & 1 : (value >> (7 - i)) & 1;
+		charge( dataPin, C_SHIFTBIT );
+		digitalWrite( dataPin, bit );
+		digitalWrite( clockPin, HIGH );
+		digitalWrite( clockPin, LOW );
+	}
+}
+
+/*
+ * SPI: once enabled, the peripheral (not the port) drives MOSI
+ * and SCK.  In mode 0 the clock idles low, each bit goes out on
+ * MOSI before the rising edge, and MISO is sampled on it.
+ */
+void SPIClass::begin() {
+	pinMode( SS, OUTPUT );
+	pinMode( MOSI, OUTPUT );
+	pinMode( SCK, OUTPUT );
+	drive( SCK, LOW );
+	spiOn = true;
+}
+
+void SPIClass::beginTransaction( SPISettings settings ) {
+	spiSet = settings;
+}
+
+uint8_t SPIClass::transfer( uint8_t out ) {
+	unsigned half = 1000000UL * CYCLES_PER_US / spiSet.clock / 2;
+	uint8_t in = 0;
+	charge( SCK, C_SPIBYTE );
+	for( int i = 0; i < 8; i++ ) {
+		int b = (spiSet.bitOrder == LSBFIRST) ? i : 7 - i;
+		drive( MOSI, (out >> b) & 1 );
+		charge( SCK, half );
+		if (level( MISO ))
+			in |= 1 << b;
+		drive( SCK, HIGH );
+		charge( SCK, half );
+		drive( SCK, LOW );
+	}
+	return( in );
+}
+
+unsigned long millis() {
+	simStats.cycles += C_CLOCK;
+	pending();
+	return simStats.cycles / (1000 * CYCLES_PER_US);
+}
+
+unsigned long micros() {
+	simStats.cycles += C_CLOCK;
+	pending();
+	return simStats.cycles / CYCLES_PER_US;
+}
+
+void delayMicroseconds( unsigned int us ) {
+	simStats.cycles += us * CYCLES_PER_US;
+	pending();
+}
+
+void set_sleep_mode( int mode ) {
+}
+
+/*
+ * idle sleep: nothing happens until the next interrupt, which
+ * is at most Timer0's next (millis) overflow
+ */
+void sleep_mode() {
+	unsigned long long wake = simStats.cycles + C_TIMER0 - simStats.cycles % C_TIMER0;
+	unsigned p = timer2Period();
+	if (p && timerLast + p > simStats.cycles && timerLast + p < wake)
+		wake = timerLast + p;
+	simStats.sleepCycles += wake - simStats.cycles;
+	simStats.cycles = wake;
+	pending();
+}
+
+int HardwareSerial::available() {
+	return serialIn >= 0;
+}
+
+int HardwareSerial::read() {
+	int c = serialIn;
+	serialIn = -1;
+	return c;
+}
+
+/*
+ * port registers
+ */
+static volatile SimPort ports[3][2] = {
+	{ { 0, false }, { 0, true } },
+	{ { 1, false }, { 1, true } },
+	{ { 2, false }, { 2, true } },
+};
+
+uint8_t digitalPinToPort( uint8_t pin ) {
+	return (pin < 8) ? 0 : (pin < 14) ? 1 : 2;
+}
+
+uint8_t digitalPinToBitMask( uint8_t pin ) {
+	return 1 << ((pin < 8) ? pin : (pin < 14) ? pin - 8 : pin - 14);
+}
+
+volatile SimPort *portOutputRegister( uint8_t port ) {
+	return &ports[port][0];
+}
+
+volatile SimPort *portInputRegister( uint8_t port ) {
+	return &ports[port][1];
+}
+
+static int portPin( int port, int bit ) {
+	static const int first[] = { 0, 8, 14 };
+	return first[port] + bit;
+}
+
+SimPort::operator uint8_t() const volatile {
+	uint8_t v = 0;
+	bool bus = false;
+	for( int b = 0; b < 8; b++ ) {
+		int pin = portPin( port, b );
+		if (pin < NUM_PINS && level( pin ))
+			v |= 1 << b;
+		bus |= (pin < NUM_PINS && isBusPin( pin ));
+	}
+	simStats.cycles += C_PORT_READ;
+	if (bus)
+		simStats.busCycles += C_PORT_READ;
+	pending();
+	return v;
+}
+
+void SimPort::operator=( uint8_t value ) volatile {
+	bool bus = false;
+	for( int b = 0; b < 8; b++ ) {
+		int pin = portPin( port, b );
+		if (pin < NUM_PINS) {
+			drive( pin, (value >> b) & 1 );
+			bus |= isBusPin( pin );
+		}
+	}
+	simStats.cycles += C_PORT_RMW;
+	if (bus)
+		simStats.busCycles += C_PORT_RMW;
+	pending();
+}
+
+void SimPort::operator|=( uint8_t bits ) volatile {
+	uint8_t v = 0;
+	for( int b = 0; b < 8; b++ ) {
+		int pin = portPin( port, b );
+		if (pin < NUM_PINS && pins[pin])
+			v |= 1 << b;
+	}
+	*this = v | bits;
+}
+
+void SimPort::operator&=( uint8_t bits ) volatile {
+	uint8_t v = 0;
+	for( int b = 0; b < 8; b++ ) {
+		int pin = portPin( port, b );
+		if (pin < NUM_PINS && pins[pin])
+			v |= 1 << b;
+	}
+	*this = v & bits;
+}
+
+/*
+ * the EEPROM: erased (all 0xFF) until something is written or
+ * an image is loaded.  A write returns right away, but the next
+ * access waits until it completes.
+ */
+static uint8_t eeprom[E2END + 1];
+static unsigned long eeWrites[E2END + 1];	// per-byte write counts
+static unsigned long long eeBusy;	// when the last write completes
+static bool eeInit;
+
+static uint8_t *eeCell( const uint8_t *addr ) {
+	if (!eeInit) {
+		memset( eeprom, 0xff, sizeof eeprom );
+		eeInit = true;
+	}
+	return &eeprom[(size_t) addr & E2END];
+}
+
+bool eeprom_is_ready() {
+	simStats.cycles += 2;
+	pending();
+	return simStats.cycles >= eeBusy;
+}
+
+static void eeWait() {
+	if (simStats.cycles < eeBusy) {
+		simStats.cycles = eeBusy;
+		pending();
+	}
+}
+
+uint8_t eeprom_read_byte( const uint8_t *addr ) {
+	eeWait();
+	simStats.cycles += C_EEREAD;
+	pending();
+	return *eeCell( addr );
+}
+
+void eeprom_write_byte( uint8_t *addr, uint8_t value ) {
+	eeWait();
+	*eeCell( addr ) = value;
+	eeWrites[(size_t) addr & E2END]++;
+	simStats.eepromWrites++;
+	simStats.cycles += C_EEREAD;
+	eeBusy = simStats.cycles + C_EEWRITE;
+	pending();
+}
+
+void eeprom_update_byte( uint8_t *addr, uint8_t value ) {
+	if (eeprom_read_byte( addr ) != value)
+		eeprom_write_byte( addr, value );
+}
+
+/*
+ * simulator controls
+ */
+void simInput( int index, bool value ) {
+	int c = index / IN_BITS;
+	if (index >= 0 && c < IN_CASCADES)
+		inputs[c][index % IN_BITS] = value;
+}
+
+bool simOutput( int index ) {
+	return (index >= 0 && index < OUT_BITS) ? outLatch[index] : false;
+}
+
+void simAnalog( int pin, int value ) {
+	if (pin >= 0 && pin < NUM_PINS)
+		analogs[pin] = value;
+}
+
+void simSerial( int c ) {
+	serialIn = c;
+}
+
+int simPin( int pin ) {
+	return (pin >= 0 && pin < NUM_PINS) ? pins[pin] : 0;
+}
+
+unsigned long simEepromWrites( int addr ) {
+	return (addr >= 0 && addr <= E2END) ? eeWrites[addr] : 0;
+}
+
+bool simEepromLoad( const char *file ) {
+	eeCell( 0 );
+	FILE *f = fopen( file, "rb" );
+	if (f == 0)
+		return false;
+	size_t n = fread( eeprom, 1, sizeof eeprom, f );
+	fclose( f );
+	return n == sizeof eeprom;
+}
+
+bool simEepromSave( const char *file ) {
+	eeCell( 0 );
+	FILE *f = fopen( file, "wb" );
+	if (f == 0)
+		return false;
+	size_t n = fwrite( eeprom, 1, sizeof eeprom, f );
+	return fclose( f ) == 0 && n == sizeof eeprom;
+}
+
+unsigned long long simOnTime( int index ) {
+	accrue();
+	return (index >= 0 && index < OUT_BITS) ? onTime[index] : 0;
+}
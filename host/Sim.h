@@ -0,0 +1,58 @@
+#ifndef SIM_H
+#define SIM_H
+/**
+ * A simulated Alarm board: the Uno's pins, the 74C165 input
+ * cascade(s) and 74HC595 output cascade described in Config.h,
+ * the analog control inputs, and the EEPROM.
+ *
+ * The simulator keeps a (cycle) clock that is advanced by the
+ * estimated cost of each Arduino pin operation, and counts pin
+ * toggles, latch events and the cycles spent on the cascade pins
+ * ("bus cycles"), so that transport and scan changes can be
+ * compared without a logic analyzer.  It does not model the
+ * cost of the (non-I/O) code between those operations.
+ */
+#include <Arduino.h>
+
+#define	CYCLES_PER_US	16	// 16MHz AVR
+
+/**
+ * counters for everything the simulator accounts for
+ */
+struct SimStats {
+	unsigned long long cycles;	// simulated clock
+	unsigned long long busCycles;	// cycles spent on cascade pins
+	unsigned long toggles;		// cascade pin transitions
+	unsigned long inLatches;	// input cascade loads
+	unsigned long outLatches;	// output cascade latches
+	unsigned long latchHash;	// hash of every latched output frame
+	unsigned long interrupts;	// timer interrupts taken
+	unsigned long eepromWrites;	// EEPROM bytes written
+	unsigned long long sleepCycles;	// cycles spent in sleep_mode
+	unsigned long pinToggles[NUM_PINS];	// per pin transitions
+};
+
+extern SimStats simStats;
+
+void simInput( int index, bool value );	// set a sensor input
+bool simOutput( int index );		// latched indicator output
+void simAnalog( int pin, int value );	// set an analog input level
+void simSerial( int c );		// queue a console character
+int simPin( int pin );			// current level of a pin
+
+/**
+ * @param index of an indicator output
+ * @return cycles that output has been latched on
+ */
+unsigned long long simOnTime( int index );
+
+/**
+ * @param addr	EEPROM address
+ * @return	number of times that byte has been written
+ */
+unsigned long simEepromWrites( int addr );
+
+// EEPROM images, so that a run can pick up where another left off
+bool simEepromLoad( const char *file );	// false if no (whole) image
+bool simEepromSave( const char *file );
+#endif
@@ -0,0 +1,15 @@
+#ifndef EEPROM_H
+#define EEPROM_H
+/*
+ * the simulated EEPROM (see Sim.cpp): reads are immediate, and
+ * a byte write keeps it busy for 3.3ms of simulated time
+ */
+#include <stdint.h>
+
+#define	E2END		1023	// last EEPROM address (ATmega328P)
+
+uint8_t eeprom_read_byte( const uint8_t *addr );
+void eeprom_write_byte( uint8_t *addr, uint8_t value );
+void eeprom_update_byte( uint8_t *addr, uint8_t value );
+bool eeprom_is_ready();
+#endif
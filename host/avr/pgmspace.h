@@ -0,0 +1,10 @@
+#ifndef PGMSPACE_H
+#define PGMSPACE_H
+/*
+ * on the host, program memory is just memory
+ */
+#define	PROGMEM
+#define	pgm_read_byte_near( p )	(*(const unsigned char *)(p))
+#define	pgm_read_word_near( p )	(*(const unsigned short *)(p))
+#define	pgm_read_dword_near( p )	(*(const unsigned long *)(p))
+#endif
@@ -0,0 +1,11 @@
+#ifndef SLEEP_H
+#define SLEEP_H
+/*
+ * the simulated sleep modes (see Sim.cpp): the clock skips ahead
+ * to the next interrupt (Timer0's, every 1024us, or Timer2's)
+ */
+#define	SLEEP_MODE_IDLE		0
+
+void set_sleep_mode( int mode );
+void sleep_mode();
+#endif
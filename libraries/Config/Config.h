@@ -8,11 +8,77 @@
 
 //#define ACTIVE_HIGH	1	// relay triggers on high
 
-#define	DEFIB		1	// enable zone defibrillation
+#define	DEFIB		1	// enable sensor defibrillation
+#define	DEBOUNCE	1	// enable sensor debouncing
+#define	SCAN_ACTIVE	1	// skip samples in which nothing changed
+#define	FAST_SHIFT	1	// shift cascades via direct port I/O
+//#define USE_SPI	1	// allow SPI (SHIFT_SPI) cascades
+#define	STATIC_SHIFT	1	// compile-time sized shift cascades
+#define	LED_ISR		1	// multiplex the LEDs from a timer interrupt
+#define	LED_BAM		1	// 8 LED brightness levels (needs LED_ISR)
+#define	EVENT_LOG	16	// size of sensor/zone event ring
+#define	EVENT_BINARY	1	// DEBUG_EVT events as binary frames
+#define	JOURNAL		1024	// EEPROM bytes for the event journal
+#define	LATENCY		1	// input edge to relay latency histograms
+//#define PROFILE	1	// time each phase of the main loop
+#define	ZONE_DELAYS	1	// zone entry and exit delays (see zonecfg)
+#define	SCHEDULE	1	// run the main loop from a table of tasks
+#define	GOVERNOR	1	// scan slowly, and sleep, when disarmed and quiet
+#define	ADC_ISR		1	// sample the controls from the ADC interrupt
+#define	STATIC_CONFIG	1	// build the scan around the Tables.h constants
 
 // maximum timeout interval ... used for wrap detection
 #define	MAX_TIMEOUT	(10*60*1000)
 
+/*
+ * With LED_ISR, Timer2 (CTC mode, 4us ticks) steps the LEDs
+ * through their red, off, green, off phases.  Shifting a frame
+ * out takes the interrupt handler most of 100us, so each phase
+ * lasts LED_SCALE times its ledcfg duration: the same ratios
+ * (and brightness), refreshed at 500Hz rather than 4KHz.
+ * (Timer2 is otherwise only used by tone and PWM on pins 3/11.)
+ */
+#define	LED_SCALE	8
+
+/*
+ * With LED_BAM, each color phase is divided into three slices
+ * of 1/7, 2/7 and 4/7 of its duration (bit angle modulation),
+ * and an LED is lit in the slices corresponding to the bits of
+ * its brightness level.  That is three cascade writes per color
+ * for 8 levels (fewer when slices are the same, as they are when
+ * everything is at full brightness).
+ */
+#if defined(LED_BAM) && !defined(LED_ISR)
+#error "LED_BAM requires LED_ISR"
+#endif
+
+/*
+ * With GOVERNOR, the scan (and LED update and event report) tasks
+ * run every SCAN_FAST ms while the system is armed, or a sensor
+ * has changed in the last SCAN_QUIET ms, and otherwise every
+ * SCAN_SLOW ms, with the CPU in idle sleep between tasks.  The
+ * first scan to see a change goes back to fast scans, so a change
+ * is reported within SCAN_SLOW + (its debounce delay * SCAN_FAST)
+ * ms: at worst 6ms (armed or busy) or 21ms (disarmed and quiet).
+ */
+#define	SCAN_FAST	1
+#define	SCAN_SLOW	16
+#define	SCAN_QUIET	30000L
+
+#if defined(GOVERNOR) && !(defined(SCHEDULE) && defined(LED_ISR))
+#error "GOVERNOR requires SCHEDULE and LED_ISR"
+#endif
+
+// DEBUG_EVT prints the events from the EVENT_LOG ring
+#if defined(DEBUG_EVT) && !defined(EVENT_LOG)
+#error "DEBUG_EVT requires EVENT_LOG"
+#endif
+
+// the JOURNAL is written from the EVENT_LOG ring
+#if defined(JOURNAL) && !defined(EVENT_LOG)
+#error "JOURNAL requires EVENT_LOG"
+#endif
+
 /**
  * These classes encapsulate the form in which we package
  * configuration information for the alarm application -
@@ -26,20 +92,22 @@
  */
 class SensorCfg {
     public:
-	char num_sensors;	// number of configured sensors
+	unsigned char num_sensors;	// number of configured sensors
 
 	const char *name(int i);// name of this sensor
 	int zone( int i );	// zone it monitors
 
 	bool sense( int i );	// non-tripped value
-	int in( int i );	// input cascade index
-	int delay( int i );	// debounce delay (us)
+	int in( int i );	// input cascade index (255 if not read)
+	int delay( int i );	// debounce delay (samples)
 
 	int red( int i );	// output cascade index
 	int green( int i );	// output cascade index
 
 	int numZones();		// number of configured zones
 	int zonePin( int i );	// output pin for each zone
+	int entryDelay( int i );	// zone entry delay (seconds)
+	int exitDelay( int i );	// zone exit delay (seconds)
 
 	/**
 	 * @param number of sensors to be configured
@@ -55,8 +123,33 @@ struct ShiftCfg {
 	char data;		// in/out pin number
 	char clock;		// output pin number
 	char latch;		// output pin number
+	char mode;		// transport (below)
+	char cascades;		// parallel input cascades
 };
 
+#define	SHIFT_SOFT	0	// clocked by software on data/clock pins
+#define	SHIFT_SPI	1	// clocked by SPI on MOSI/MISO and SCK
+
+/*
+ * the shift register cascades (see inCfg/outCfg in Config.cpp).
+ * These are here, rather than in Config.cpp, so that STATIC_SHIFT
+ * can size and wire the cascades at compile time.
+ */
+#define	IN_REGS		4	// 74C165 sensor inputs
+#define	IN_DATA		5
+#define	IN_CLOCK	6
+#define	IN_LATCH	7
+#define	IN_MODE		SHIFT_SOFT
+#define	IN_CASCADES	1	// data on IN_DATA, IN_DATA+1, ...
+				// (IN_REGS*8*IN_CASCADES <= 255, as the
+				//  Tables.h input indices are bytes)
+
+#define	OUT_REGS	8	// 74HC595 indicator outputs
+#define	OUT_DATA	2
+#define	OUT_CLOCK	3
+#define	OUT_LATCH	4
+#define	OUT_MODE	SHIFT_SOFT
+
 /**
  * configurations for LED duty cycles
  */
@@ -68,6 +161,10 @@ class LedCfg {
 	int slow();		// slow blink (ms)
 	int med();		// medium blink (ms)
 	int fast();		// fast blink (ms)
+	int lvRed();		// red brightness (0-7)
+	int lvGreen();		// green brightness (0-7)
+	int lvHot();		// triggered red brightness (0-7)
+	int lvNight();		// dimmed brightness limit (0-7)
 };
 
 /**
@@ -79,6 +176,7 @@ class CtrlCfg {
 	int pin(int i);		// analog pin to read
 	bool sense(int i);	// high asserted?
 	int scale(int i);	// full scale reading
+	int hysteresis(int i);	// dead band around it (ADC_ISR)
 	int minInterval();	// min reasonable inter-trigger (ms)
 	int maxTriggers();	// max consecutive triggers
 
@@ -0,0 +1,342 @@
+#ifndef TABLES_H
+#define TABLES_H
+/*
+ * the configuration tables themselves
+ *
+ * These are constexpr arrays of structures (in PROGMEM), so that
+ * the compiler can check them (see the static_asserts at the end)
+ * and work out everything that follows from them: the number of
+ * sensors and zones, the sense, input and zone masks, and the
+ * debounce delays as bit-planes.  Config.cpp reads them through
+ * the SensorCfg/LedCfg/CtrlCfg accessors, and with STATIC_CONFIG
+ * the SensorManager is built around the compile-time numbers.
+ *
+ * (This is C++11, so the constexpr functions are all a single
+ *  return statement, and loops are recursion.)
+ */
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include <Config.h>
+
+/*
+ * this is the configuration of all of the zone
+ * alarm relays.
+ *
+ * With ZONE_DELAYS, once the system is armed, the sensors
+ * in a zone do not trip its relay until its exit delay has
+ * passed (time to leave), and the first one that opens after
+ * that only does so if the system is still armed when its
+ * entry delay has passed (time to get to the panel).
+ */
+#define	Z_dis	0	// disabled ... ignore
+#define	Z_ent	1	// entry
+#define	Z_ext	2	// external perimeter
+#define	Z_brk	3	// window breakage
+#define	Z_int	4	// OK if people are home
+
+struct ZoneDef {
+	signed char pin;	// relay output pin
+	unsigned char entry;	// entry delay (seconds)
+	unsigned char exit;	// exit delay (seconds)
+};
+
+constexpr ZoneDef zonecfg[] PROGMEM = {
+//   pin  entry  exit
+  {   8,   30,   60 },	// Z_ent	front, garage, back entries
+  {   9,    0,    0 },	// Z_ext
+  {  10,    0,    0 },	// Z_brk
+  {  11,    0,   60 },	// Z_int	stairway motion on the way out
+};
+constexpr int NUM_ZONES = sizeof zonecfg / sizeof zonecfg[0];
+
+/* sense of signal	*/
+#define	S_hi	0x80	// signal is normally high
+#define	S_lo	0x00	// signal is normally low
+
+/*
+ * debounce periods, in samples (at most 7, see DB_BITS).
+ * Reed and mechanical switches settle faster than we scan,
+ * but a tilted mercury switch can splash for a while, and
+ * an IR motion sensor chatters as someone walks past.
+ */
+#define D_none 0	// digital signal debounce
+#define D_reed 0	// magnetic reed debounce
+#define D_mech 0	// mechanical switch debounce
+#define D_merc 3	// mercury switch debounce
+#define D_mot  5	// infra-red motion sensor
+
+#define	I_none	255	// no input: the sensor is not read
+
+struct SensorDef {
+	signed char zone;	// zone it monitors (Z_dis for none)
+	unsigned char info;	// misc config info (sense)
+	unsigned char in;	// input shift index (or I_none)
+	unsigned char red;	// red output index
+	unsigned char green;	// green output index
+	unsigned char delay;	// debounce count
+};
+
+/*
+ * this is the configuration of all of the sensors
+ *
+ * if the input port is I_none, the sensor will not be read
+ * (input ports beyond IN_REGS*8 are in subsequent cascades)
+ * if the zone is Z_dis the sensor cannot trigger anything
+ */
+constexpr SensorDef sensorcfg[] PROGMEM = {
+//   zone   info    in   red   grn   debounce	location	pr#/color
+  {  Z_ext, S_lo,    0,    0,    1,   D_reed },	// front rm rt  T14/blu
+  {  Z_ext, S_lo, I_none,   2,    3,   D_none },	// removed
+  {  Z_brk, S_lo, I_none,   4,    5,   D_none },	// removed
+  {  Z_int, S_lo,    3,    6,    7,   D_reed },	// closet door	T22/blu
+  {  Z_ext, S_lo,    4,    8,    9,   D_mech },	// bell tamper	T13/grn
+  {  Z_int, S_lo,    5,   10,   11,   D_reed },	// mstr br sld	T21/brn
+  {  Z_int, S_lo,    6,   12,   13,   D_reed },	// laundry sld	B16/blu
+  {  Z_int, S_lo,    7,   14,   15,   D_reed },	// laundry door	B17/brn
+  {  Z_ent, S_lo,    8,   16,   17,   D_reed },	// front entry	T23/blu
+  {  Z_ent, S_lo,    9,   18,   19,   D_reed },	// garage door	T24/orn
+  {  Z_ext, S_lo,   10,   20,   21,   D_reed },	// shop door	T25/grn
+  {  Z_int, S_lo,   11,   22,   23,   D_reed },	// din rm sld	B20/blu
+  {  Z_ext, S_lo,   12,   24,   25,   D_reed },	// north br	T18/blu	JUMPERED
+  {  Z_brk, S_lo,   13,   26,   27,   D_merc },	// n br brk L	T19/orn
+  {  Z_brk, S_lo,   14,   28,   29,   D_merc },	// n br brk R	T20/orn JUMPERED
+  {  Z_int, S_lo,   15,   30,   31,   D_mot  },	// stairway 	NO SENSOR
+  {  Z_ent, S_lo,   16,   32,   33,   D_reed },	// back entry	B14/blu
+  {  Z_ext, S_lo,   17,   34,   35,   D_reed },	// basement dr	B15/grn
+  {  Z_brk, S_lo,   18,   36,   37,   D_merc },	// stdy brk s L	B05/orn
+  {  Z_brk, S_lo,   19,   38,   39,   D_merc },	// stdy brk s R	B06/grn
+  {  Z_ext, S_lo,   20,   40,   41,   D_reed },	// play room	B01/blu
+  {  Z_brk, S_lo,   21,   42,   43,   D_merc },	// ply brk L	B02/orn
+  {  Z_brk, S_lo,   22,   44,   45,   D_merc },	// ply brk R	B03/grn
+  {  Z_ext, S_lo,   23,   46,   47,   D_reed },	// study south	B04/blu
+  {  Z_ext, S_lo,   24,   48,   49,   D_reed },	// play rm sld	B10/blu
+  {  Z_brk, S_lo,   25,   50,   51,   D_merc },	// ply sld brkL	B11/orn
+  {  Z_brk, S_lo,   26,   52,   53,   D_merc },	// ply sld brkR	B12/grn
+  {  Z_int, S_lo,   27,   54,   55,   D_reed },	// south office	B13/brn
+  {  Z_ext, S_lo,   28,   56,   57,   D_reed },	// study north	B07/blu
+  {  Z_brk, S_lo,   29,   58,   59,   D_merc },	// stdy brk n L	B08/orn
+  {  Z_brk, S_lo,   30,   60,   61,   D_merc },	// stdy brk n R	B09/grn
+  {  Z_ext, S_lo, I_none,  62,   63,   D_mech },	// key tamper	back	NOTYET
+};
+constexpr int NUM_SENSORS = sizeof sensorcfg / sizeof sensorcfg[0];
+
+/*
+ * this is the configuration for the LEDs
+ * (duty cycles, blink rates, and LED_BAM brightness levels:
+ *  0-7 for red, green, triggered red, and the night limit)
+ */
+struct LedDef {
+	short red, green, off;		// duty cycle (us)
+	short slow, med, fast;		// blink periods (ms)
+	short lvRed, lvGreen, lvHot, lvNight;	// brightness (0-7)
+};
+
+constexpr LedDef ledcfg PROGMEM =
+//	red	green	off	slow	med	fast	lvred	lvgrn	lvhot	lvnite
+{	100,	100,	50,	1000,	500,	250,	5,	7,	7,	2 };
+
+/*
+ * this is the configuration for the control input signals
+ */
+#define	C_lo	0	// low asserted
+#define	C_hi	1	// high asserted
+
+/*
+ * With ADC_ISR, a control only changes state once its (filtered)
+ * reading is more than the hysteresis beyond the threshold.
+ */
+struct CtrlDef {
+	short pin;		// analog input pin
+	short sense;		// C_lo or C_hi
+	short thresh;		// ADC reading between low and high
+	short hysteresis;	// (ADC counts)
+};
+
+constexpr CtrlDef ctrlcfg[] PROGMEM = {
+//	pin	sense	thresh	hysteresis
+  {	A0,	C_lo,	512,	32 },
+  {	A1,	C_lo,	512,	32 },
+  {	A2,	C_lo,	512,	32 },
+  {	A3,	C_lo,	512,	32 },
+  {	A4,	C_lo,	512,	32 },
+  {	A5,	C_lo,	512,	32 },
+};
+constexpr int NUM_CONTROLS = sizeof ctrlcfg / sizeof ctrlcfg[0];
+
+/*
+ * things that follow from the sensor table
+ */
+#define	CFG_BITS	32	// sensors per bit-plane word (as S_BITS)
+constexpr int CFG_WORDS = (NUM_SENSORS + CFG_BITS - 1) / CFG_BITS;
+
+/**
+ * @param f	predicate on (sensor, arg)
+ * @param arg	its second argument
+ * @param w	word number (sensors 32*w ... 32*w+31)
+ * @param b	first bit to consider
+ * @return	mask of the sensors in that word for which f holds
+ */
+constexpr unsigned long sensorMask( bool (*f)( int, int ), int arg, int w,
+				    int b = 0 ) {
+	return (b >= CFG_BITS || w * CFG_BITS + b >= NUM_SENSORS) ? 0 :
+		(f( w * CFG_BITS + b, arg ) ? 1UL << b : 0) |
+		sensorMask( f, arg, w, b + 1 );
+}
+
+constexpr bool isHigh( int i, int ) { return (sensorcfg[i].info & S_hi) != 0; }
+constexpr bool isUsed( int i, int ) { return sensorcfg[i].in != I_none; }
+constexpr bool inZone( int i, int z ) { return sensorcfg[i].zone == z; }
+constexpr bool delayBit( int i, int k ) { return (sensorcfg[i].delay >> k) & 1; }
+
+/*
+ * the masks, by word (w) or by zone/bit and word (j = n * CFG_WORDS + w)
+ */
+constexpr unsigned long senseWord( int w ) { return sensorMask( isHigh, 0, w ); }
+constexpr unsigned long usedWord( int w ) { return sensorMask( isUsed, 0, w ); }
+constexpr unsigned long zoneWord( int j ) {
+	return sensorMask( inZone, j / CFG_WORDS + 1, j % CFG_WORDS );
+}
+constexpr unsigned long delayWord( int j ) {
+	return sensorMask( delayBit, j / CFG_WORDS, j % CFG_WORDS );
+}
+
+/*
+ * the LED outputs, by sensor
+ */
+constexpr unsigned char redOutput( int i ) { return sensorcfg[i].red; }
+constexpr unsigned char greenOutput( int i ) { return sensorcfg[i].green; }
+
+/**
+ * @param i	first sensor to consider
+ * @param m	longest delay so far
+ * @return	longest debounce delay
+ */
+constexpr int maxDelay( int i = 0, int m = 0 ) {
+	return (i >= NUM_SENSORS) ? m :
+		maxDelay( i + 1, sensorcfg[i].delay > m ? sensorcfg[i].delay : m );
+}
+
+/**
+ * @param n	input index
+ * @param i	first sensor to consider
+ * @return	the (first) sensor read from that input (-1 if none)
+ */
+constexpr int inputSensor( int n, int i = 0 ) {
+	return (i >= NUM_SENSORS) ? -1 :
+		(sensorcfg[i].in == n) ? i : inputSensor( n, i + 1 );
+}
+
+/**
+ * @param i	first sensor to consider
+ * @return	is sensor i read from input i (for all that are read)
+ */
+constexpr bool isIdentity( int i = 0 ) {
+	return (i >= NUM_SENSORS) ? true :
+		(sensorcfg[i].in == I_none || sensorcfg[i].in == i) &&
+		isIdentity( i + 1 );
+}
+
+/**
+ * @param o	output index
+ * @param red	look at the red (or green) outputs
+ * @param i	first sensor to consider
+ * @return	number of sensors whose red (or green) LED is that output
+ */
+constexpr int outputUses( int o, bool red, int i = 0 ) {
+	return (i >= NUM_SENSORS) ? 0 :
+		((red ? sensorcfg[i].red : sensorcfg[i].green) == o) +
+		outputUses( o, red, i + 1 );
+}
+
+/**
+ * @param r	output register
+ * @param red	red (or green) outputs
+ * @param b	first bit to consider
+ * @return	mask of the outputs in that register that are red (or green)
+ */
+constexpr unsigned char outputMask( int r, bool red, int b = 0 ) {
+	return (b >= 8) ? 0 :
+		(outputUses( r * 8 + b, red ) ? 1 << b : 0) |
+		outputMask( r, red, b + 1 );
+}
+
+/*
+ * checks on the tables, so that a mistake in them is a compile
+ * error rather than a sensor that silently never trips
+ */
+constexpr bool sensorsOK( int i = 0 ) {
+	return (i >= NUM_SENSORS) ? true :
+		(sensorcfg[i].zone >= Z_dis && sensorcfg[i].zone <= NUM_ZONES) &&
+		(sensorcfg[i].in == I_none ||
+		 (sensorcfg[i].in < IN_REGS * 8 * IN_CASCADES &&
+		  inputSensor( sensorcfg[i].in ) == i)) &&
+		sensorcfg[i].red < OUT_REGS * 8 &&
+		sensorcfg[i].green < OUT_REGS * 8 &&
+		sensorsOK( i + 1 );
+}
+
+constexpr bool outputsOK( int r = 0 ) {
+	return (r >= OUT_REGS) ? true :
+		(outputMask( r, true ) & outputMask( r, false )) == 0 &&
+		outputsOK( r + 1 );
+}
+
+constexpr bool noDuplicates( int i = 0 ) {
+	return (i >= NUM_SENSORS) ? true :
+		outputUses( sensorcfg[i].red, true ) == 1 &&
+		outputUses( sensorcfg[i].green, false ) == 1 &&
+		noDuplicates( i + 1 );
+}
+
+constexpr bool pinOnce( int p, int z ) {
+	return (z >= NUM_ZONES) ? true :
+		zonecfg[z].pin != p && pinOnce( p, z + 1 );
+}
+
+constexpr bool zonesOK( int z = 0 ) {
+	return (z >= NUM_ZONES) ? true :
+		zonecfg[z].pin >= 0 && pinOnce( zonecfg[z].pin, z + 1 ) &&
+		zonesOK( z + 1 );
+}
+
+constexpr bool controlsOK( int i = 0 ) {
+	return (i >= NUM_CONTROLS) ? true :
+		(ctrlcfg[i].thresh - ctrlcfg[i].hysteresis > 0 &&
+		 ctrlcfg[i].thresh + ctrlcfg[i].hysteresis < 1023) &&
+		controlsOK( i + 1 );
+}
+
+constexpr bool levelOK( int lv ) { return lv >= 0 && lv <= 7; }
+
+static_assert( NUM_SENSORS < 255, "sensor numbers must fit in a byte" );
+static_assert( IN_REGS * 8 * IN_CASCADES <= I_none, "input indices must fit in a byte (below I_none)" );
+static_assert( OUT_REGS * 8 <= 256, "output indices must fit in a byte" );
+static_assert( NUM_ZONES <= 7, "zones 1-7 are bits of a byte" );
+static_assert( NUM_CONTROLS <= 8, "controls are bits of a byte" );
+static_assert( sensorsOK(), "sensor zone, input or output index out of range, or input read twice" );
+static_assert( noDuplicates(), "two sensors share an LED output" );
+static_assert( outputsOK(), "an output is both a red and a green LED" );
+static_assert( zonesOK(), "zone without a relay pin, or two zones on one pin" );
+static_assert( controlsOK(), "control threshold +/- hysteresis out of ADC range" );
+static_assert( levelOK( ledcfg.lvRed ) && levelOK( ledcfg.lvGreen ) &&
+	       levelOK( ledcfg.lvHot ) && levelOK( ledcfg.lvNight ),
+	       "LED brightness levels are 0-7" );
+
+/*
+ * With STATIC_CONFIG, the derived masks (and LED outputs) are baked
+ * into flash: Derived< T, f, Upto<n>::seq >::v[] is the array of T
+ * { f(0), ... f(n-1) }.
+ */
+template <int... I> struct Seq {};
+template <int N, int... I> struct Upto : Upto<N - 1, N - 1, I...> {};
+template <int... I> struct Upto<0, I...> { typedef Seq<I...> seq; };
+
+template <typename T, T (*F)( int ), typename S> struct Derived;
+template <typename T, T (*F)( int ), int... I>
+struct Derived< T, F, Seq<I...> > {
+	static constexpr T v[sizeof...(I)] PROGMEM = { F( I )... };
+};
+template <typename T, T (*F)( int ), int... I>
+constexpr T Derived< T, F, Seq<I...> >::v[sizeof...(I)];
+
+#endif
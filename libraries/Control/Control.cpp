@@ -4,6 +4,14 @@
 
 extern int debug;	// enable debug output
 
+#ifdef ADC_ISR
+static ControlManager *sampled;	// the controls the ADC is converting
+
+ISR(ADC_vect) {
+	sampled->convert();
+}
+#endif
+
 /**
  * create a managed set of control bits
  *
@@ -25,6 +33,36 @@ ControlManager::ControlManager( Config *config ) {
 		}
 #endif
 	}
+
+#ifdef ADC_ISR
+	/*
+	 * read each control once (the slow way) so that we start out
+	 * with their current states, and then let the ADC interrupt
+	 * take over, converting one control per Timer0 overflow
+	 */
+	int n = cfg->controls->num_bits;
+	level = (unsigned short *) malloc( n * sizeof (unsigned short) );
+	highs = 0;
+	lows = 0;
+	for (int i = 0; i < n; i++ ) {
+		unsigned value = analogRead( cfg->controls->pin(i) );
+		level[i] = value << CTRL_FRAC;
+		if (value > (unsigned) cfg->controls->scale(i))
+			highs |= 1 << i;
+		if (!cfg->controls->sense(i))
+			lows |= 1 << i;
+	}
+	channel = 0;
+	sampled = this;
+
+	unsigned char oldSREG = SREG;
+	cli();
+	ADMUX = (1 << REFS0) | (cfg->controls->pin(0) - A0);
+	ADCSRB = 1 << ADTS2;		// trigger on Timer0 overflow
+	ADCSRA = (1 << ADEN) | (1 << ADATE) | (1 << ADIE) |
+		 (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0);	// clk/128
+	SREG = oldSREG;
+#endif
 }
 
 
@@ -32,6 +70,9 @@ ControlManager::ControlManager( Config *config ) {
  * read the status of the control bits and return a mask full of them
  */
 char ControlManager::read() {
+#ifdef ADC_ISR
+	return( highs ^ lows );
+#else
 	char ret = 0;
 	for (int i = 0; i < cfg->controls->num_bits; i++ ) {
 		unsigned value = analogRead( cfg->controls->pin(i) );
@@ -41,4 +82,31 @@ char ControlManager::read() {
 
 	}
 	return( ret );
+#endif
+}
+
+#ifdef ADC_ISR
+/**
+ * take the conversion that has just completed (for the current
+ * channel), filter it, see if it moves its control out of the
+ * dead band on the other side of the threshold, and set the
+ * multiplexor for the next conversion (at the next overflow)
+ */
+void ControlManager::convert() {
+	int i = channel;
+	unsigned value = ADC;
+	level[i] += ((int) (value << CTRL_FRAC) - (int) level[i]) >> CTRL_EMA;
+
+	int t = cfg->controls->scale(i);
+	int h = cfg->controls->hysteresis(i);
+	int v = level[i] >> CTRL_FRAC;
+	if (v > t + h)
+		highs |= 1 << i;
+	else if (v < t - h)
+		highs &= ~(1 << i);
+
+	if (++channel >= cfg->controls->num_bits)
+		channel = 0;
+	ADMUX = (1 << REFS0) | (cfg->controls->pin(channel) - A0);
 }
+#endif
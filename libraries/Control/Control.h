@@ -3,6 +3,19 @@
 
 #define	MAX_CONTROL 8
 
+/*
+ * With ADC_ISR, the ADC converts one control after each Timer0
+ * (millis) overflow, every 1024us, and its interrupt handler
+ * keeps a filtered level for each: an exponential moving average
+ * (new = old + (reading - old) / 2^CTRL_EMA) of the readings, in
+ * fixed point (CTRL_FRAC fraction bits).  A control changes state
+ * when that crosses its threshold by more than its hysteresis.
+ * With six controls, each is read every 6ms, and a change in a
+ * control is seen within about 20ms.
+ */
+#define	CTRL_EMA	2	// filter weight of a new reading (1/4)
+#define	CTRL_FRAC	4	// fraction bits of the filtered levels
+
 /**
  * a managed collection of input control bits
  */
@@ -18,10 +31,25 @@ class ControlManager {
     
     /**
      * return the status of the input control bits
+     * (with ADC_ISR, the ones last seen by the interrupt handler)
      */
     char read();
 
+#ifdef ADC_ISR
+    /**
+     * take the conversion that has just completed, and set the
+     * ADC up for the next control (called from the ADC interrupt)
+     */
+    void convert();
+#endif
+
   private:
     Config	*cfg;		// configuration object
+#ifdef ADC_ISR
+    unsigned short *level;	// filtered reading of each control
+    volatile unsigned char highs;	// controls above their thresholds
+    unsigned char lows;		// controls that are asserted low
+    unsigned char channel;	// control being converted
+#endif
 };
 #endif
@@ -0,0 +1,239 @@
+/*
+ * This module implements a single-producer/single-consumer
+ * ring of events, so that the sensor scan can record what
+ * it sees without waiting for whoever reports it, and the
+ * binary frames in which they can be reported.
+ */
+#include <Arduino.h>
+#include <Event.h>
+
+/*
+ * keep the compiler from moving slot accesses across the (volatile)
+ * index update that hands the slot to the other side
+ */
+#define	BARRIER()	__asm__ __volatile__ ("" ::: "memory")
+
+/**
+ * create an event ring
+ *
+ * @param slots	number of events (rounded down to a power of two, <= 128)
+ * @param buffer	static event buffer (or 0 to allocate one)
+ */
+EventLog::EventLog( int slots, Event *buffer ) {
+	// the free-running indices can tell full from empty for <= 128
+	if (slots > 128)
+		slots = 128;
+	while( slots & (slots - 1) )
+		slots &= slots - 1;
+	if (slots < 1)
+		slots = 1;
+
+	ring = buffer ? buffer : (Event *) malloc( slots * sizeof (Event) );
+	mask = slots - 1;
+	head = 0;
+	tail = 0;
+	dropped = 0;
+}
+
+/**
+ * record an event (producer)
+ *
+ * @param what	cause (E_*)
+ * @param sensor	sensor index (or 255)
+ * @param zone	zone number
+ * @param state	new state
+ * @param time	millis() when it happened
+ * @return		false if the ring was full (and the event dropped)
+ */
+bool EventLog::put( unsigned char what, unsigned char sensor, unsigned char zone,
+		    unsigned char state, unsigned long time ) {
+	unsigned char h = head;
+	if ((unsigned char) (h - tail) > mask) {
+		dropped++;
+		return( false );
+	}
+
+	// fill in the slot before the consumer can see it
+	Event *e = &ring[h & mask];
+	e->time = time;
+	e->what = what;
+	e->sensor = sensor;
+	e->zone = zone;
+	e->state = state;
+	BARRIER();
+	head = h + 1;
+	return( true );
+}
+
+/**
+ * take the oldest event from the ring (consumer)
+ *
+ * @param e		where to copy the event
+ * @return		false if there were no events
+ */
+bool EventLog::get( Event *e ) {
+	unsigned char t = tail;
+	if (t == head)
+		return( false );
+
+	// copy the slot out before the producer can reuse it
+	*e = ring[t & mask];
+	BARRIER();
+	tail = t + 1;
+	return( true );
+}
+
+/**
+ * @param crc	CRC so far (0 to start)
+ * @param b	next byte
+ * @return	updated CRC-8
+ */
+unsigned char eventCrc( unsigned char crc, unsigned char b ) {
+	crc ^= b;
+	for( int i = 0; i < 8; i++ )
+		crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+	return( crc );
+}
+
+EventEncoder::EventEncoder() {
+	last = 0;
+	sinceMark = 0;
+}
+
+/**
+ * @param e	event to be encoded
+ * @param buf	where to put the frame (at least EVENT_FRAME bytes)
+ * @return	length of the frame
+ */
+int EventEncoder::encode( const Event *e, unsigned char *buf ) {
+	unsigned char hdr = (e->what << EF_WHAT) | (e->zone & EF_ZONE);
+	if (e->state)
+		hdr |= EF_STATE;
+
+	// every so often, send the absolute time
+	unsigned long t = e->time - last;
+	if (sinceMark == 0) {
+		hdr |= EF_ABS;
+		t = e->time;
+	}
+	sinceMark = (sinceMark + 1) % EVENT_MARK;
+	last = e->time;
+
+	int n = 0;
+	buf[n++] = EVENT_SYNC;
+	buf[n++] = hdr;
+	while( t >= 0x80 ) {
+		buf[n++] = (t & 0x7f) | 0x80;
+		t >>= 7;
+	}
+	buf[n++] = t;
+	if (E_HAS_SENSOR( e->what ))
+		buf[n++] = e->sensor;
+
+	unsigned char crc = 0;
+	for( int i = 1; i < n; i++ )
+		crc = eventCrc( crc, buf[i] );
+	buf[n++] = crc;
+	return( n );
+}
+
+EventDecoder::EventDecoder() {
+	frames = 0;
+	errors = 0;
+	timed = false;
+	len = 0;
+	synced = false;
+	last = 0;
+}
+
+/**
+ * see whether buf holds a whole frame
+ *
+ * @return	length of the frame, 0 if incomplete, -1 if invalid
+ */
+int EventDecoder::complete() {
+	if (len < 1)
+		return( 0 );
+
+	// find the end of the time
+	int n = 1;
+	while( n < len && (buf[n] & 0x80) )
+		n++;
+	if (n > 5)
+		return( -1 );		// too long to be a time
+	if (n >= len)
+		return( 0 );
+	n++;
+
+	if (E_HAS_SENSOR( buf[0] >> EF_WHAT ))
+		n++;
+	if (len < n + 1)
+		return( 0 );
+
+	unsigned char crc = 0;
+	for( int i = 0; i < n; i++ )
+		crc = eventCrc( crc, buf[i] );
+	return( crc == buf[n] ? n + 1 : -1 );
+}
+
+/**
+ * @param c	next byte of the stream
+ * @param e	where to put a decoded event
+ * @return	true if c completed a valid frame
+ */
+bool EventDecoder::feed( unsigned char c, Event *e ) {
+	if (!synced) {
+		synced = (c == EVENT_SYNC);
+		len = 0;
+		return( false );
+	}
+
+	buf[len++] = c;
+	int n = complete();
+	if (n == 0)
+		return( false );
+
+	if (n < 0) {
+		/*
+		 * not a frame: the sync we started from was just data,
+		 * so look for another one in what we have collected
+		 */
+		errors++;
+		unsigned char rest[EVENT_FRAME];
+		int r = len;
+		for( int i = 0; i < r; i++ )
+			rest[i] = buf[i];
+		synced = false;
+		len = 0;
+		bool got = false;
+		for( int i = 0; i < r; i++ )
+			if (feed( rest[i], e ))
+				got = true;
+		return( got );
+	}
+
+	// decode the frame
+	unsigned char hdr = buf[0];
+	unsigned long t = 0;
+	int i = 1;
+	for( int shift = 0; ; shift += 7 ) {
+		t |= (unsigned long) (buf[i] & 0x7f) << shift;
+		if (!(buf[i++] & 0x80))
+			break;
+	}
+	if (hdr & EF_ABS) {
+		last = t;
+		timed = true;
+	} else
+		last += t;
+
+	e->time = last;
+	e->what = hdr >> EF_WHAT;
+	e->state = (hdr & EF_STATE) ? 1 : 0;
+	e->zone = hdr & EF_ZONE;
+	e->sensor = E_HAS_SENSOR( e->what ) ? buf[i] : 255;
+	frames++;
+	synced = false;
+	len = 0;
+	return( true );
+}
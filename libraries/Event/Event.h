@@ -0,0 +1,162 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+/*
+ * event causes
+ */
+#define	E_NONE		0
+#define	E_SENSOR	1	// sensor changed (state: 1 = normal)
+#define	E_ARM		2	// zone (0 = system) armed (state: 1 = armed)
+#define	E_TEST		3	// lamp test (state: 1 = started, 0 = done)
+#define	E_TRIGGER	4	// sensor triggered its (armed) zone (state: 1)
+#define	E_BOOT		5	// power on
+
+// does an event with this cause have a sensor number
+#define	E_HAS_SENSOR(what)	((what) == E_SENSOR || (what) == E_TRIGGER)
+
+/**
+ * a (compact) record of something that happened
+ */
+struct Event {
+	unsigned long time;	// millis() when it happened
+	unsigned char what;	// cause (E_*)
+	unsigned char sensor;	// sensor index (255 if none)
+	unsigned char zone;	// zone number
+	unsigned char state;	// new state (see causes)
+};
+
+/**
+ * a fixed size ring of events, with a single producer (the
+ * scan) and a single consumer (whoever reports them).
+ *
+ * Each side only writes its own (single byte, and hence atomic)
+ * index, so neither needs to lock out the other.  put() is a
+ * few stores, with no I/O, and when the ring is full it counts
+ * the event as dropped rather than waiting.
+ */
+class EventLog {
+
+  public:
+    /**
+     * create an event ring
+     *
+     * @param slots	number of events (rounded down to a power of two, <= 128)
+     * @param buffer	static event buffer (or 0 to allocate one)
+     */
+    EventLog( int slots, Event *buffer = 0 );
+
+    /**
+     * record an event (producer)
+     *
+     * @param what	cause (E_*)
+     * @param sensor	sensor index (or 255)
+     * @param zone	zone number
+     * @param state	new state
+     * @param time	millis() when it happened
+     * @return		false if the ring was full (and the event dropped)
+     */
+    bool put( unsigned char what, unsigned char sensor, unsigned char zone,
+    	      unsigned char state, unsigned long time );
+
+    /**
+     * take the oldest event from the ring (consumer)
+     *
+     * @param e		where to copy the event
+     * @return		false if there were no events
+     */
+    bool get( Event *e );
+
+    /**
+     * @return number of events waiting in the ring
+     */
+    unsigned char count() { return (unsigned char) (head - tail); }
+
+    unsigned long dropped;	// events lost because the ring was full
+
+  private:
+    Event *ring;		// event slots
+    unsigned char mask;		// slots - 1
+    volatile unsigned char head;	// events put (producer only)
+    volatile unsigned char tail;	// events gotten (consumer only)
+};
+
+/*
+ * binary event frames (about a quarter the size of a log line)
+ *
+ *	sync	EVENT_SYNC
+ *	header	bits 7-5: cause, 4: absolute time, 3: state, 2-0: zone
+ *	time	varint (7 bits per byte, low order first, high bit set
+ *		on all but the last): ms since the previous event, or
+ *		(with the absolute bit) millis()
+ *	sensor	sensor index (E_SENSOR and E_TRIGGER frames only)
+ *	crc	CRC-8 (polynomial 0x07) of header through sensor
+ *
+ * A sensor change a few ms after the previous event is 5 bytes.
+ * Every EVENT_MARK'th frame carries an absolute time, so that a
+ * decoder that starts (or loses sync) mid-stream can recover.
+ */
+#define	EVENT_SYNC	0xA5
+#define	EVENT_FRAME	9	// longest frame
+#define	EVENT_MARK	32	// frames between absolute times
+
+#define	EF_ABS		0x10	// header: time is absolute
+#define	EF_STATE	0x08	// header: new state
+#define	EF_ZONE		0x07	// header: zone number
+#define	EF_WHAT		5	// header: shift for the cause
+
+/**
+ * @param crc	CRC so far (0 to start)
+ * @param b	next byte
+ * @return	updated CRC-8
+ */
+unsigned char eventCrc( unsigned char crc, unsigned char b );
+
+/**
+ * turns events into binary frames
+ */
+class EventEncoder {
+
+  public:
+    EventEncoder();
+
+    /**
+     * @param e	event to be encoded
+     * @param buf	where to put the frame (at least EVENT_FRAME bytes)
+     * @return	length of the frame
+     */
+    int encode( const Event *e, unsigned char *buf );
+
+  private:
+    unsigned long last;		// time of previous event
+    unsigned char sinceMark;	// frames since an absolute time
+};
+
+/**
+ * turns a stream of bytes back into events
+ * (skipping anything that is not a valid frame)
+ */
+class EventDecoder {
+
+  public:
+    EventDecoder();
+
+    /**
+     * @param c	next byte of the stream
+     * @param e	where to put a decoded event
+     * @return	true if c completed a valid frame
+     */
+    bool feed( unsigned char c, Event *e );
+
+    unsigned long frames;	// valid frames decoded
+    unsigned long errors;	// frames with bad CRCs or lengths
+    bool timed;			// have seen an absolute time
+
+  private:
+    unsigned char buf[EVENT_FRAME];	// frame so far (after the sync)
+    unsigned char len;		// bytes in buf (0 = looking for sync)
+    bool synced;		// have seen a sync
+    unsigned long last;		// time of previous event
+
+    int complete();		// check for a whole frame
+};
+#endif
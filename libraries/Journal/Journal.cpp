@@ -0,0 +1,145 @@
+/*
+ * This module keeps a history of events in the EEPROM, so that
+ * what happened before a power failure (and whether or not we
+ * were armed) survives it.
+ *
+ * The EEPROM is good for about 100,000 writes per byte.  Were we
+ * to keep, e.g., the arm state in a fixed place, a few hundred
+ * events a day would wear it out in a year or two.  Spreading
+ * the records around a ring of N slots makes that N times longer.
+ */
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include <Journal.h>
+
+/**
+ * find the newest record in an EEPROM journal
+ *
+ * @param bytes	size of the journal (in EEPROM bytes)
+ * @param base	EEPROM address of the journal
+ */
+Journal::Journal( int bytes, int b ) {
+	base = b;
+	slots = bytes / JOURNAL_REC;
+	left = 0;
+	writes = 0;
+
+	/*
+	 * Slots 0 ... newest hold consecutive sequence numbers,
+	 * starting with slot 0's.  Those after it are erased, or
+	 * left from the previous trip around the ring (and hence
+	 * slots lower than they would be), so we can binary search
+	 * for the last slot whose number follows on from slot 0's.
+	 */
+	unsigned short first = seqAt( 0 );
+	if (first == JOURNAL_NONE || slots < 1) {
+		newest = -1;
+		count = 0;
+		seq = JOURNAL_SEQS - 1;		// so the first append is 0
+		return;
+	}
+	int lo = 0;		// known to follow on
+	int hi = slots;		// known not to (or off the end)
+	while( hi - lo > 1 ) {
+		int mid = (lo + hi) / 2;
+		if (seqAt( mid ) == (unsigned short) ((first + mid) % JOURNAL_SEQS))
+			lo = mid;
+		else
+			hi = mid;
+	}
+	newest = lo;
+	seq = seqAt( lo );
+
+	// if the next slot has never been written, we have not wrapped
+	if (lo + 1 < slots && seqAt( lo + 1 ) == JOURNAL_NONE)
+		count = lo + 1;
+	else
+		count = slots;
+}
+
+/**
+ * @param slot	record number
+ * @return	its EEPROM address
+ */
+uint8_t *Journal::at( int slot ) {
+	return( (uint8_t *) (size_t) (base + slot * JOURNAL_REC) );
+}
+
+/**
+ * @param slot	record number
+ * @return	its sequence number (JOURNAL_NONE if erased)
+ */
+unsigned short Journal::seqAt( int slot ) {
+	const uint8_t *p = at( slot );
+	return eeprom_read_byte( p ) | ((unsigned) eeprom_read_byte( p + 1 ) << 8);
+}
+
+/**
+ * queue an event to be written (lamp tests and the changes of
+ * fibrillating sensors are not journaled)
+ *
+ * @param e		event to be recorded
+ * @param chatter	it is a change of a fibrillating sensor
+ * @return		false if a previous record is still being written
+ */
+bool Journal::append( const Event *e, bool chatter ) {
+	if (left != 0 || slots < 1)
+		return( false );
+	if (e->what == E_TEST || (e->what == E_SENSOR && chatter))
+		return( true );
+
+	unsigned short s = (seq + 1) % JOURNAL_SEQS;
+	rec[0] = s & 0xff;
+	rec[1] = s >> 8;
+	rec[2] = (e->what << EF_WHAT) | (e->zone & EF_ZONE) | (e->state ? EF_STATE : 0);
+	rec[3] = e->sensor;
+	for( int i = 0; i < 4; i++ )
+		rec[4 + i] = e->time >> (8 * i);
+	left = JOURNAL_REC;
+	return( true );
+}
+
+/**
+ * continue writing the queued record: start the next byte write
+ * if the EEPROM has finished the last one.
+ */
+void Journal::poll() {
+	if (left == 0 || !eeprom_is_ready())
+		return;
+
+	// the payload (bytes 2-7) first, and the sequence number last
+	int slot = (newest + 1) % slots;
+	int i = (JOURNAL_REC + 2 - left) % JOURNAL_REC;
+	uint8_t *p = at( slot ) + i;
+	eeprom_update_byte( p, rec[i] );	// (no write if unchanged)
+	if (--left > 0)
+		return;
+
+	// that completes the record
+	newest = slot;
+	seq = (seq + 1) % JOURNAL_SEQS;
+	if (count < slots)
+		count++;
+	writes++;
+}
+
+/**
+ * @param back	how many records back (0 = the newest)
+ * @param e	where to put the event
+ * @return	false if the journal does not go back that far
+ */
+bool Journal::read( int back, Event *e ) {
+	if (back < 0 || back >= count)
+		return( false );
+
+	const uint8_t *p = at( (newest - back + slots) % slots );
+	unsigned char hdr = eeprom_read_byte( p + 2 );
+	e->what = hdr >> EF_WHAT;
+	e->state = (hdr & EF_STATE) ? 1 : 0;
+	e->zone = hdr & EF_ZONE;
+	e->sensor = eeprom_read_byte( p + 3 );
+	e->time = 0;
+	for( int i = 3; i >= 0; i-- )
+		e->time = (e->time << 8) | eeprom_read_byte( p + 4 + i );
+	return( true );
+}
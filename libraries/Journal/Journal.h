@@ -0,0 +1,88 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <Arduino.h>
+#include <Event.h>
+
+/*
+ * journal records (fixed size, so that slot n is at 8*n)
+ *
+ *	seq	sequence number (2 bytes, low order first):
+ *		0 ... JOURNAL_SEQS-1, 0xFFFF (erased) if never written
+ *	header	as in a binary event frame (cause, state, zone)
+ *	sensor	sensor index (or 255)
+ *	time	millis() (4 bytes, low order first)
+ *
+ * Successive appends go in successive slots (wrapping around),
+ * with successive sequence numbers, so every cell is written once
+ * per trip around the journal rather than once per event.
+ */
+#define	JOURNAL_REC	8		// bytes per record
+#define	JOURNAL_SEQS	65535		// sequence numbers wrap at this
+#define	JOURNAL_NONE	0xFFFF		// sequence number of an erased slot
+
+/**
+ * a circular, wear-leveled history of events in the EEPROM
+ *
+ * An AVR EEPROM byte write takes 3.3ms, so rather than waiting
+ * for a whole record, append() queues it and poll() starts one
+ * byte write each time the EEPROM is ready.  The sequence number
+ * is written last, so a record torn by a power failure is not
+ * recognized as the newest, and only that record is lost.
+ */
+class Journal {
+
+  public:
+    /**
+     * find the newest record in an EEPROM journal
+     *
+     * @param bytes	size of the journal (in EEPROM bytes)
+     * @param base	EEPROM address of the journal
+     */
+    Journal( int bytes, int base = 0 );
+
+    /**
+     * @return	can another record be appended
+     */
+    bool ready() { return( left == 0 ); }
+
+    /**
+     * queue an event to be written (lamp tests are not journaled,
+     * nor are the changes of a sensor that is fibrillating, which
+     * could otherwise wear the EEPROM out in weeks; arms, triggers
+     * and boots always are)
+     *
+     * @param e		event to be recorded
+     * @param chatter	it is a change of a fibrillating sensor
+     * @return		false if a previous record is still being written
+     */
+    bool append( const Event *e, bool chatter = false );
+
+    /**
+     * continue writing the queued record (a byte at a time)
+     */
+    void poll();
+
+    /**
+     * @param back	how many records back (0 = the newest)
+     * @param e		where to put the event
+     * @return		false if the journal does not go back that far
+     */
+    bool read( int back, Event *e );
+
+    int count;			// records in the journal
+    unsigned long writes;	// records written
+
+  private:
+    int base;			// EEPROM address of slot 0
+    int slots;			// number of records
+    int newest;			// slot of newest record (-1 if none)
+    unsigned short seq;		// sequence number of newest record
+
+    unsigned char rec[JOURNAL_REC];	// record being written
+    unsigned char left;		// bytes of it still to be written
+
+    uint8_t *at( int slot );		// EEPROM address of a slot
+    unsigned short seqAt( int slot );	// sequence number in a slot
+};
+#endif
@@ -0,0 +1,189 @@
+/*
+ * This module runs the main loop's tasks, each at its own rate,
+ * and keeps track of how late they start and how long they take,
+ * so that the rates can be tuned (latency versus CPU time).
+ */
+#include <Arduino.h>
+#include <Sched.h>
+#include <avr/sleep.h>
+#include <stdio.h>
+
+/**
+ * add a time to a total kept in ms (with the leftover us kept
+ * separately), which does not wrap for 49 days, where a total
+ * in us would wrap after 71 minutes
+ *
+ * @param ms	total (ms)
+ * @param us	leftover (us, under 1000)
+ * @param add	time to be added (us)
+ */
+static void accrue( unsigned long *ms, unsigned short *us, unsigned long add ) {
+	add += *us;
+	if (add >= 1000) {
+		*ms += add / 1000;
+		add %= 1000;
+	}
+	*us = add;
+}
+
+/**
+ * @param table	tasks to be run
+ * @param n	number of tasks
+ */
+Scheduler::Scheduler( Task *table, int n ) {
+	tasks = table;
+	numTasks = n;
+	unsigned long now = millis();
+	for( int i = 0; i < n; i++ )
+		tasks[i].next = now;
+	reset();
+}
+
+/**
+ * forget the statistics gathered so far
+ */
+void Scheduler::reset() {
+	passes = 0;
+	asleep = 0;
+	asleepUs = 0;
+	since = millis();
+	for( int i = 0; i < numTasks; i++ ) {
+		Task *t = &tasks[i];
+		t->runs = 0;
+		t->overruns = 0;
+		t->ms = 0;
+		t->us = 0;
+		t->late = 0;
+		t->longest = 0;
+	}
+}
+
+/**
+ * run every task that is due
+ *
+ * @param now	millis()
+ */
+void Scheduler::run( unsigned long now ) {
+	passes++;
+	for( int i = 0; i < numTasks; i++ ) {
+		Task *t = &tasks[i];
+		long late = now - t->next;
+		if (late < 0)
+			continue;
+
+		// note how late it is, and when it is next due
+		if (late > (long) t->deadline)
+			t->overruns++;
+		if (late > t->late)
+			t->late = (late > 0xffff) ? 0xffff : late;
+		t->next += t->period;
+		if ((long) (now - t->next) >= 0)
+			t->next = now + t->period;	// fell a period behind
+
+		unsigned long start = micros();
+		(*t->run)();
+		unsigned long us = micros() - start;
+		t->runs++;
+		accrue( &t->ms, &t->us, us );
+		if (us > t->longest)
+			t->longest = (us > 0xffff) ? 0xffff : us;
+	}
+}
+
+/**
+ * @param now	millis()
+ * @return	is any task due
+ */
+bool Scheduler::due( unsigned long now ) {
+	for( int i = 0; i < numTasks; i++ )
+		if ((long) (now - tasks[i].next) >= 0)
+			return( true );
+	return( false );
+}
+
+/**
+ * put the CPU in idle sleep until a task is due
+ *
+ * An interrupt between the check and the sleep can cost us
+ * (at most) one extra millis() tick of sleep.
+ */
+void Scheduler::idle() {
+	if (due( millis() ))
+		return;
+	unsigned long start = micros();
+	set_sleep_mode( SLEEP_MODE_IDLE );
+	do
+		sleep_mode();
+	while( !due( millis() ) );
+	accrue( &asleep, &asleepUs, micros() - start );
+}
+
+/**
+ * change how often a task runs (if it is next due later than
+ * the new period, it is next due a period from now)
+ *
+ * @param tag		task to be changed
+ * @param period	ms between runs
+ * @return		false if there is no such task
+ */
+bool Scheduler::retime( char tag, unsigned period ) {
+	for( int i = 0; i < numTasks; i++ ) {
+		Task *t = &tasks[i];
+		if (t->tag != tag)
+			continue;
+		unsigned long now = millis();
+		t->period = period;
+		if ((long) (t->next - now) > (long) period)
+			t->next = now + period;
+		return( true );
+	}
+	return( false );
+}
+
+/**
+ * @param t	task
+ * @return	its average run time (us)
+ */
+static unsigned long average( Task *t ) {
+	if (t->runs == 0)
+		return( 0 );
+	if (t->ms < 4000000UL)		// ms * 1000 still fits in 32 bits
+		return( (t->ms * 1000 + t->us) / t->runs );
+	if (t->runs >= 1000)
+		return( t->ms / (t->runs / 1000) );
+	return( t->ms / t->runs * 1000 );
+}
+
+/**
+ * @param part	a share of
+ * @param whole	(part <= whole)
+ * @return	part as a percentage of whole
+ */
+static unsigned long percent( unsigned long part, unsigned long whole ) {
+	if (whole == 0)
+		return( 0 );
+	if (whole < 40000000UL)		// part * 100 still fits in 32 bits
+		return( part * 100 / whole );
+	return( part / (whole / 100) );
+}
+
+/**
+ * print the time spent awake (per cent), and a line for each task:
+ * period, runs, overruns, latest start (ms), longest and average
+ * run times (us), and share (per cent) of the time spent in tasks
+ */
+void Scheduler::print() {
+	unsigned long total = 0;	// (ms)
+	for( int i = 0; i < numTasks; i++ )
+		total += tasks[i].ms;
+	unsigned long elapsed = millis() - since;
+
+	printf("passes=%lu awake=%lu%%\n", passes,
+		100 - asleep / (elapsed / 100 + 1));
+	for( int i = 0; i < numTasks; i++ ) {
+		Task *t = &tasks[i];
+		printf("%c p=%u n=%lu o=%lu late=%u max=%u avg=%lu %lu%%\n", t->tag,
+			t->period, t->runs, t->overruns, t->late, t->longest,
+			average( t ), percent( t->ms, total ));
+	}
+}
@@ -0,0 +1,95 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+/**
+ * a periodic task, in a (static) table of them
+ *
+ * The first four fields are the task's configuration, and the
+ * rest are kept by the scheduler (and can be left out of the
+ * table's initializers).
+ */
+struct Task {
+	void (*run)();		// what to do
+	unsigned period;	// ms between runs (0 = every pass)
+	unsigned deadline;	// ms after it is due that it may start
+	char tag;		// character identifying it in reports
+
+	unsigned long next;	// millis() when it is next due
+	unsigned long runs;	// times it has run
+	unsigned long overruns;	// times it started after its deadline
+	unsigned long ms;	// total time it has taken (ms)
+	unsigned short us;	// and beyond that (us, under 1000)
+	unsigned short late;	// latest it has started (ms)
+	unsigned short longest;	// longest it has taken (us)
+};
+
+/**
+ * a cooperative scheduler for a static table of periodic tasks
+ *
+ * Each pass runs (in table order) every task that is due, and
+ * schedules its next run a period after it was due (so that it
+ * keeps its rate), unless it has fallen a whole period behind,
+ * in which case the missed runs are skipped.  A task that starts
+ * more than its deadline after it was due is an overrun, and the
+ * time each task takes shows which of them is starving the rest.
+ */
+class Scheduler {
+
+  public:
+    /**
+     * @param table	tasks to be run
+     * @param n		number of tasks
+     */
+    Scheduler( Task *table, int n );
+
+    /**
+     * run every task that is due
+     *
+     * @param now	millis()
+     */
+    void run( unsigned long now );
+
+    /**
+     * @param now	millis()
+     * @return		is any task due
+     */
+    bool due( unsigned long now );
+
+    /**
+     * put the CPU in idle sleep until a task is due (the timers,
+     * and so millis() and the LED interrupt, keep running, and
+     * the millis() interrupt wakes it at least every 1024us)
+     */
+    void idle();
+
+    /**
+     * change how often a task runs
+     *
+     * @param tag	task to be changed
+     * @param period	ms between runs
+     * @return		false if there is no such task
+     */
+    bool retime( char tag, unsigned period );
+
+    /**
+     * print the time spent awake, and a line for each task: period,
+     * runs, overruns, latest start, longest and average run times,
+     * and share of the time spent in tasks
+     */
+    void print();
+
+    /**
+     * forget the statistics gathered so far
+     */
+    void reset();
+
+    unsigned long passes;	// calls to run
+    unsigned long asleep;	// time spent in idle (ms)
+    unsigned long since;	// millis() when the statistics were reset
+
+  private:
+    Task *tasks;		// the task table
+    int numTasks;		// number of tasks in it
+    unsigned short asleepUs;	// time spent in idle, beyond asleep ms (us)
+};
+#endif
@@ -9,11 +9,51 @@
 #include <Config.h>
 #include <Sensor.h>
 #include <Arduino.h>
+#ifdef JOURNAL
+#include <Journal.h>
+#endif
 
 extern int debug;	// debug level
 
-#ifdef DEBUG_EVT
-extern void logTime( unsigned long );
+#ifdef STATIC_CONFIG
+/*
+ * the sense, input and zone masks, the debounce delays (as DB_BITS
+ * planes), and the LED outputs, worked out from sensorcfg by the
+ * compiler
+ */
+typedef Derived< unsigned long, senseWord, Upto< CFG_WORDS >::seq > SenseMasks;
+typedef Derived< unsigned long, usedWord, Upto< CFG_WORDS >::seq > UsedMasks;
+typedef Derived< unsigned long, zoneWord, Upto< NUM_ZONES * CFG_WORDS >::seq > ZoneMasks;
+typedef Derived< unsigned long, delayWord, Upto< DB_BITS * CFG_WORDS >::seq > DelayMasks;
+typedef Derived< unsigned char, redOutput, Upto< NUM_SENSORS >::seq > RedOutputs;
+typedef Derived< unsigned char, greenOutput, Upto< NUM_SENSORS >::seq > GreenOutputs;
+
+static_assert( CFG_BITS == S_BITS, "Tables.h and Sensor.h word sizes differ" );
+static_assert( maxDelay() < (1 << DB_BITS), "debounce delay longer than DB_BITS can count" );
+#endif
+
+#ifdef LED_ISR
+static SensorManager *multiplexed;	// whose LEDs Timer2 is driving
+
+// the frame (within a set) that is shown in each multiplex phase
+#ifdef LED_BAM
+static const unsigned char phaseFrame[LED_PHASES] = { 0, 1, 2, 6, 3, 4, 5, 6 };
+#else
+static const unsigned char phaseFrame[LED_PHASES] = { 0, 2, 1, 2 };
+#endif
+
+/**
+ * @param us	duration (of an unscaled multiplex phase)
+ * @return	OCR2A value for LED_SCALE times that duration
+ */
+static unsigned char timerTicks( long us ) {
+	long t = us * LED_SCALE / 4;	// clk/64 is 4us per tick
+	return (t < 1) ? 0 : (t > 256) ? 255 : t - 1;
+}
+
+ISR(TIMER2_COMPA_vect) {
+	multiplexed->multiplex();
+}
 #endif
 
 /**
@@ -22,15 +62,22 @@ extern void logTime( unsigned long );
  * @param config object
  * @param input	InShifter for the sensors
  * @param output OutShifter for the indicators
+ * @param log	ring for sensor/zone events (or 0 for none)
  */
 SensorManager::SensorManager(	Config *config,
-				InShifter *input, OutShifter *output ) {
+				InCascade *input, OutCascade *output,
+				EventLog *log ) {
 	// note our lower level resource managers
 	cfg = config;
 	inshifter = input;
 	outshifter = output;
+	events = log;
 	zoneArmed = 0;
 	zoneState = 0;
+	rescan = true;
+	scans = 0;
+	idle = 0;
+	touched = 0;
 
 #ifdef	DEBUG_CFG
 	if (debug) {
@@ -39,23 +86,126 @@ SensorManager::SensorManager(	Config *config,
 			cfg->leds->fast(), cfg->leds->med(), cfg->leds->slow());
 	}
 #endif
-	// allocate and intialize the sensor status and debounce arrays
-	states = (unsigned char *) malloc( cfg->sensors->num_sensors );
-#ifdef DEBOUNCE
-	debounce = (unsigned char *) malloc( cfg->sensors->num_sensors );
+	// allocate and intialize the sensor state bit-planes
+	int n = cfg->sensors->num_sensors;
+#ifndef STATIC_CONFIG
+	numWords = (n + S_BITS - 1) / S_BITS;
 #endif
+	states = (sbits *) malloc( S_PLANES * numWords * sizeof (sbits) );
+	for ( int i = 0; i < S_PLANES * numWords; i++ )
+		states[i] = 0;
 #ifdef DEFIB
-	defib = (unsigned char *) malloc( cfg->sensors->numZones() );
-	nextUpdate = 0;
+	nextLeak = 0;
+	leaking = false;
 #endif
-	for ( int i = 0; i < cfg->sensors->num_sensors; i++ ) {
-		// all sensors start out normal, all enabled sensors green
-		states[i] = S_status | S_prev | (cfg->sensors->sense(i) ? S_sense : 0);	
-		if (cfg->sensors->in(i) != 255)
-			states[i] |= S_green;
-#ifdef DEBOUNCE
-		debounce[i] = 0;	// we are not currently debouncing
+
+	// allocate the LED frame cache, and start the blink phases
+	int r = outshifter->numRegs;
+#ifdef LED_ISR
+	int nf = 2 * LED_FRAMES * r;	// one set to show, one to compose
+#else
+	int nf = LED_FRAMES * r;
+#endif
+#ifdef LED_BAM
+	levels = (char *) malloc( 3 * r );
+	dimmed = false;
+#endif
+	layers = (char *) malloc( 8 * r );
+	frames = (char *) malloc( nf );
+	for ( int i = 0; i < nf; i++ )
+		frames[i] = 0;		// everything starts out dark
+	newLeds = true;
+	unsigned long now = millis();
+	phases = 1 << led_none;
+	for ( int c = led_slow; c <= led_fast; c++ )
+		blinkSync( c, now );
+#ifdef PROFILE
+	profile = new Profile( p_phases, "ISFDRC" );	// (before the interrupts)
+#endif
+
+#ifdef LED_ISR
+	// convert the multiplex phase durations into timer ticks
+	int p = 0;
+#ifdef LED_BAM
+	for ( int b = 0; b < 3; b++ )
+		ledTicks[p++] = timerTicks( (long) cfg->leds->usRed() * (1 << b) / 7 );
+	ledTicks[p++] = timerTicks( cfg->leds->usOff()/2 );
+	for ( int b = 0; b < 3; b++ )
+		ledTicks[p++] = timerTicks( (long) cfg->leds->usGreen() * (1 << b) / 7 );
+#else
+	ledTicks[p++] = timerTicks( cfg->leds->usRed() );
+	ledTicks[p++] = timerTicks( cfg->leds->usOff()/2 );
+	ledTicks[p++] = timerTicks( cfg->leds->usGreen() );
+#endif
+	ledTicks[p++] = timerTicks( (1 + cfg->leds->usOff())/2 );
+	shown = frames;
+	ledPhase = LED_PHASES - 1;	// first interrupt starts the red phase
+	multiplexed = this;
+
+	// start Timer2 in CTC mode, clk/64, interrupt on compare match A
+	unsigned char oldSREG = SREG;
+	cli();
+	TCCR2A = 1 << WGM21;
+	TCCR2B = 1 << CS22;
+	TCNT2 = 0;
+	OCR2A = ledTicks[ledPhase];
+	TIMSK2 = 1 << OCIE2A;
+	SREG = oldSREG;
 #endif
+
+	// build the zone membership masks
+#ifdef STATIC_CONFIG
+	members = (sbits *) malloc( numZones * numWords * sizeof (sbits) );
+	counts = (unsigned char *) malloc( Z_COUNTS * (numZones + 1) );
+	for ( int i = 0; i < numZones * numWords; i++ )
+		members[i] = pgm_read_dword_near( &ZoneMasks::v[i] );
+
+	// all sensors start out normal, all enabled sensors green
+	for ( int w = 0; w < numWords; w++ ) {
+		sbits all = (w < n / S_BITS) ? ~(sbits) 0 :
+				((sbits) 1 << (n % S_BITS)) - 1;
+		sbits used = pgm_read_dword_near( &UsedMasks::v[w] );
+		plane(S_status)[w] = all;
+		plane(S_prev)[w] = all;
+		plane(S_sense)[w] = pgm_read_dword_near( &SenseMasks::v[w] );
+		plane(S_used)[w] = used;
+		plane(S_green)[w] = used;
+	}
+#ifdef DEBUG_CFG
+	for ( int i = 0; debug && i < n; i++ )
+		printf("Sensor: %s zone=%d, s/d=<%d,%d>, in=%d, <red,grn>=<%d,%d>\n",
+			cfg->sensors->name(i),
+			cfg->sensors->zone(i),
+			cfg->sensors->sense(i),
+			cfg->sensors->delay(i),
+			cfg->sensors->in(i),
+			cfg->sensors->red(i),
+			cfg->sensors->green(i) );
+#endif
+#else
+	numZones = cfg->sensors->numZones();
+	members = (sbits *) malloc( numZones * numWords * sizeof (sbits) );
+	counts = (unsigned char *) malloc( Z_COUNTS * (numZones + 1) );
+	for ( int i = 0; i < numZones * numWords; i++ )
+		members[i] = 0;
+	for ( int i = 0; i < n; i++ ) {
+		int z = cfg->sensors->zone(i);
+		if (z >= 1 && z <= numZones)
+			zoneBits(z)[i / S_BITS] |= (sbits) 1 << (i % S_BITS);
+	}
+
+	identity = true;
+	for ( int i = 0; i < n; i++ ) {
+		// all sensors start out normal, all enabled sensors green
+		setBit( S_status, i, true );
+		setBit( S_prev, i, true );
+		setBit( S_sense, i, cfg->sensors->sense(i) );
+		if (cfg->sensors->in(i) != 255) {
+			setBit( S_used, i, true );
+			setBit( S_green, i, true );
+			if (cfg->sensors->in(i) != i)
+				identity = false;
+		}
 #ifdef DEBUG_CFG
 		if (debug) {
 			printf("Sensor: %s zone=%d, s/d=<%d,%d>, in=%d, <red,grn>=<%d,%d>\n",
@@ -70,6 +220,8 @@ SensorManager::SensorManager(	Config *config,
 #endif
 	}
 	
+#endif
+
 	// configure the zone relay control pins
 	for( int i = 1; i <= cfg->sensors->numZones(); i++ ) {
 		int p = cfg->sensors->zonePin(i);
@@ -80,121 +232,540 @@ SensorManager::SensorManager(	Config *config,
 				printf("Relay: %d, pin=%d\n", i, p);
 #endif
 		}
-#ifdef DEFIB
-		defib[i] = 0;
-#endif
 	}
+	recount();
+
+#ifdef ZONE_DELAYS
+	timers = new TimerWheel( numZones, DELAY_SLOTS, DELAY_TICK );
+	entrant = (unsigned char *) malloc( numZones + 1 );
+	entryZones = 0;
+	for( int z = 1; z <= numZones; z++ )
+		if (cfg->sensors->entryDelay( z ) > 0)
+			entryZones |= 1 << z;
+	exiting = 0;
+	entering = 0;
+	alarmed = 0;
+#endif
+
+#ifdef LATENCY
+	edgeTime = (unsigned long *) malloc( (numZones + 1) * sizeof (unsigned long) );
+	edges = 0;
+	relays = 0;
+	readTime = 0;
+#endif
 }
 
 
+/**
+ * gather the (raw) input bits for 32 sensors
+ *
+ * When every sensor's input index is its own sensor number
+ * (as it is on this board) this is just a word of the input
+ * snapshot.  Otherwise we have to look each one up.
+ *
+ * @param w	word number (sensors 32*w ... 32*w+31)
+ * @return	input bits, sensor 32*w in the low order bit
+ */
+sbits SensorManager::inputs( int w ) {
+	if (identity)
+		return inshifter->word( w );
+
+	sbits raw = 0;
+	sbits used = plane(S_used)[w];
+	for( sbits m = used; m != 0; m &= m - 1 ) {
+		int b = __builtin_ctzl( m );
+		if (inshifter->get( cfg->sensors->in( w * S_BITS + b ) ))
+			raw |= (sbits) 1 << b;
+	}
+	return( raw );
+}
+
 /**
  * read all of the inputs, debounce them, and update
  * the sensor and LED status accordingly.
  *
+ * All of the per-sensor state is kept in bit-planes, so
+ * normalization, stability, zone and trigger state, and
+ * the resulting LED state are computed for 32 sensors at
+ * a time with word operations.  The only per-sensor work
+ * is for sensors that changed or that are in a triggering
+ * zone.
+ *
  * Notes on defibrilation:
  *	We burned up some relays as a result of a failing sensor.
 
  *	ctrl->minInterval() is fastest acceptable change rate
  *	ctrl->maxTriggers() is defibrilation threshold
- *	we increment a per-zone count every time a sensor changes
- *	we decrement the count every minInterval
- *	while count > maxTriggers, we consider zone to be fibrilating
- *		and it is not allowed to trigger an alarm
- *	we fast blink any triggered sensor in a fibrilating zone
+ *	we add a token to a sensor's bucket every time it changes
+ *	we take a token from every bucket every minInterval
+ *	while tokens >= maxTriggers, we consider the sensor to be
+ *		fibrilating and it is not allowed to trigger an alarm
+ *		(but the other sensors in its zone still are)
+ *	we fast blink a fibrilating sensor if it is open or triggered
  */
 void SensorManager::sample() {
 
 	// latch the current values
+#ifdef PROFILE
+	unsigned long t0 = micros();
+#endif
 	inshifter->read();
+#ifdef PROFILE
+	unsigned long t1 = micros();
+	profile->add( p_shift, t1 - t0 );
+#endif
+	scans++;
+	touched = 0;
+#ifdef LATENCY
+	unsigned long t = micros();
+	if (scans > 1)
+		period.add( t - readTime );
+	readTime = t;
+#endif
+
+#ifdef SCAN_ACTIVE
+	/*
+	 * In a quiet house nothing has changed since the last sample,
+	 * and unless something else has (arming, a bucket leaking below
+	 * the defibrilation threshold, the lamp test) the sensor, relay
+	 * and LED states would all come out exactly as they already are.
+	 */
+	bool busy = inshifter->changes || rescan;
+#ifdef DEBOUNCE
+	/*
+	 * A changed sensor is not reported until a later sample finds
+	 * it stable, even when it has no delay (and no counter running).
+	 */
+	for( int w = 0; w < numWords; w++ )
+		if ((plane(S_prev)[w] ^ plane(S_status)[w]) & plane(S_used)[w])
+			busy = true;
+	for( int k = 0; k < DB_BITS; k++ )
+		for( int w = 0; w < numWords; w++ )
+			if (plane(S_count + k)[w] != 0)
+				busy = true;
+#endif
+	if (!busy) {
+		idle++;
+#ifdef PROFILE
+		profile->add( p_sample, micros() - t1 );
+#endif
+		return;
+	}
+#endif
+	rescan = false;
 
 	// start all relays out normal
 	zoneState = 0;
 
 	// note whether or not system is currently armed
-	unsigned char armed = zoneArmed & 1;
-	
-	// run through all of the configured sensors
-	for( int i = 0; i < cfg->sensors->num_sensors; i++ ) {
-
-	    // if sensor isn't configured ignore it
-	    int x = cfg->sensors->in(i);
-	    if (x == 255) {
-		setLed(i, led_off, led_none);	// show no status
-		continue;
-	    }
-
-	    // get the current (normalized) value of this sensor
-	    bool v = (inshifter->get( x ) == cfg->sensors->sense(i));
-
-	    // see if the value is stable (same as last sample)
-	    if (v != previous(i)) {
-		previous(i,v);
+	sbits armed = (zoneArmed & 1) ? ~(sbits) 0 : 0;
+
+	sbits *status = plane(S_status);
+	sbits *prev = plane(S_prev);
+	sbits *used = plane(S_used);
+	sbits *stable = plane(S_stable);
+
+	/*
+	 * pass 1: normalize the inputs, note which are stable,
+	 *	   and update the reported status of the stable ones
+	 */
+	for( int w = 0; w < numWords; w++ ) {
+		// get the current (normalized: 1 = normal) values
+		sbits v = ~(inputs( w ) ^ plane(S_sense)[w]) & used[w];
+
+		// see if the value is stable (same as last sample)
+		sbits changed = (v ^ prev[w]) & used[w];
+		prev[w] ^= changed;
+#ifdef LATENCY
+		// note when each zone first saw a change
+		if (changed)
+			for( int z = 1; z <= numZones; z++ )
+				if ((changed & zoneBits(z)[w]) && !(edges & (1 << z))) {
+					edgeTime[z] = readTime;
+					edges |= 1 << z;
+				}
+#endif
+		stable[w] = used[w];
 #ifdef DEBOUNCE
-		debounce[i] = cfg->sensors->delay(i) + 1;
-	    } 
+		/*
+		 * A changed sensor is unstable for this sample and the
+		 * next delay(i) samples.  Count down the running counters
+		 * (all at once), and then (re)load those that changed.
+		 */
+		sbits running = 0;
+		for( int k = 0; k < DB_BITS; k++ )
+			running |= plane(S_count + k)[w];
+		running &= ~changed;
+		sbits borrow = running;
+		for( int k = 0; k < DB_BITS; k++ ) {
+			sbits c = plane(S_count + k)[w];
+			plane(S_count + k)[w] = c ^ borrow;
+			borrow &= ~c;
+		}
+#ifdef STATIC_CONFIG
+		// the delays are bit-planes too, so this is word-wide
+		if (changed)
+			for( int k = 0; k < DB_BITS; k++ ) {
+				sbits d = pgm_read_dword_near( &DelayMasks::v[k * numWords + w] );
+				plane(S_count + k)[w] = (plane(S_count + k)[w] & ~changed) |
+							(d & changed);
+			}
+#else
+		for( sbits m = changed; m != 0; m &= m - 1 ) {
+			sbits bit = m & -m;
+			int d = cfg->sensors->delay( w * S_BITS + __builtin_ctzl( m ) );
+			if (d >= (1 << DB_BITS))
+				d = (1 << DB_BITS) - 1;
+			for( int k = 0; k < DB_BITS; k++ )
+				if (d & (1 << k))
+					plane(S_count + k)[w] |= bit;
+				else
+					plane(S_count + k)[w] &= ~bit;
+		}
+#endif
+		stable[w] &= ~(changed | running);
+		touched += __builtin_popcountl( changed | running );
+#else
+		touched += __builtin_popcountl( changed );
+#endif
 
-	    if (debounce[i] > 0) {
-		debounce[i] = debounce[i] - 1;
-		continue;
+		// see if the stable value is a change
+		sbits flipped = (v ^ status[w]) & stable[w];
+		status[w] ^= flipped;
+		tally( Z_open, w, flipped & ~status[w], flipped & status[w] );
+#ifdef	EVENT_LOG
+		for( sbits m = flipped; events && m != 0; m &= m - 1 ) {
+			int i = w * S_BITS + __builtin_ctzl( m );
+			events->put( E_SENSOR, i, cfg->sensors->zone(i),
+				     (v & m & -m) != 0, millis() );
+		}
+#endif
+#ifdef DEFIB
+		/*
+		 * each transition adds a token to the sensor's bucket
+		 * (a vertical increment, which stops at a full bucket)
+		 */
+		if (flipped) {
+			sbits full = ~(sbits) 0;
+			for( int k = 0; k < FIB_BITS; k++ )
+				full &= plane(S_tokens + k)[w];
+			sbits carry = flipped & ~full;
+			for( int k = 0; k < FIB_BITS; k++ ) {
+				sbits c = plane(S_tokens + k)[w];
+				plane(S_tokens + k)[w] = c ^ carry;
+				carry &= c;
+			}
+			fibCheck( w );
+			if (!leaking) {
+				leaking = true;
+				nextLeak = millis() + 1000L * cfg->controls->minInterval();
+			}
+		}
 #endif
-	    }
+	}
+
+	/*
+	 * pass 2: zone relays, trigger latching, and LED states
+	 *	   for all of the stable sensors
+	 */
+	sbits *trigger = plane(S_trigger);
+	sbits *enabled = plane(S_enabled);
+	sbits *fibs = plane(S_fib);
+	for( int w = 0; w < numWords; w++ ) {
+		sbits s = stable[w];
+		sbits normal = status[w] & s;
+		sbits open = ~status[w] & s;
 
-	    // note what zone this sensor is in
-	    int z = cfg->sensors->zone(i);
+		// open (non-fibrilating) sensors in enabled zones trigger
+		sbits hot = open & enabled[w] & ~fibs[w];
+#ifdef ZONE_DELAYS
+		/*
+		 * while the system is armed, the first sensor to open in
+		 * a zone with an entry delay starts its countdown, and the
+		 * sensors in zones that are counting down trip nothing
+		 */
+		sbits quiet = 0;
+		if (armed && (exiting | entering | (entryZones & ~alarmed)))
+			for( int z = 1; z <= numZones; z++ ) {
+				unsigned char bit = 1 << z;
+				sbits m = hot & zoneBits(z)[w];
+				if (m && (entryZones & ~(exiting | entering | alarmed) & bit))
+					enter( z, w * S_BITS + __builtin_ctzl( m ) );
+				if ((exiting | entering) & bit)
+					quiet |= zoneBits(z)[w];
+			}
+		hot &= ~quiet;
+#endif
+		if (hot)
+			for( int z = 1; z <= numZones; z++ )
+				if (hot & zoneBits(z)[w])
+					zoneState |= 1 << z;
+		sbits newly = hot & armed & ~trigger[w];
+#ifdef	EVENT_LOG
+		for( sbits m = newly; events && m != 0; m &= m - 1 ) {
+			int i = w * S_BITS + __builtin_ctzl( m );
+			events->put( E_TRIGGER, i, cfg->sensors->zone(i), 1, millis() );
+		}
+#endif
+		trigger[w] |= newly;
+		tally( Z_trig, w, newly, 0 );
+
+		/*
+		 * LED color and blink for each sensor
+		 *	open:		red if armed, else yellow
+		 *			(fast blink if fibrilating)
+		 *	triggered:	red, medium blink
+		 *			(fast blink if fibrilating)
+		 *	normal:		green (slow blink if armed)
+		 */
+		sbits ae = armed & enabled[w];
+		sbits trig = normal & trigger[w];
+		sbits calm = normal & ~trigger[w];
+		sbits fast = (open | trig) & fibs[w];
+#ifdef ZONE_DELAYS
+		fast |= quiet & s;	// counting down
+#endif
+		sbits red = open | trig;
+		sbits green = (open & ~ae) | calm;
+		sbits blo = fast | (calm & ae);
+		sbits bhi = fast | (trig & ~fibs[w]);
+
+		// unconfigured sensors show no status
+		sbits x = s | ~used[w];
+		red |= plane(S_red)[w] & ~x;
+		green |= plane(S_green)[w] & ~x;
+		blo |= plane(S_b_lo)[w] & ~x;
+		bhi |= plane(S_b_hi)[w] & ~x;
+		if (red != plane(S_red)[w] || green != plane(S_green)[w] ||
+		    blo != plane(S_b_lo)[w] || bhi != plane(S_b_hi)[w]) {
+			plane(S_red)[w] = red;
+			plane(S_green)[w] = green;
+			plane(S_b_lo)[w] = blo;
+			plane(S_b_hi)[w] = bhi;
+			newLeds = true;
+		}
+	}
+#ifdef ZONE_DELAYS
+	zoneState |= alarmed;	// held until the system is disarmed
+#endif
+#ifdef PROFILE
+	profile->add( p_sample, micros() - t1 );
+#endif
+}
 
-	    // see if the stable value is a change
-	    if (v != status(i)) {
-	        status( i, v );
 #ifdef DEFIB
-		// count recent transitions in each zone
-		if (z >= 1 && z <= 8 && defib[z] < 255)
-			defib[z]++;
-#endif
-#ifdef	DEBUG_EVT
-		if (debug > 1) {	
-			// excuse: strings take up data space
-			logTime( millis() );
-			putchar( v == 0 ? '!' : '-' );
-			putchar(' ');
-			putchar('S');
-			putchar('=');
-			putchar('0' + i/10);
-			putchar('0' + i%10);
-			putchar('\n');
+/**
+ * see which sensors have (or no longer have) too many tokens
+ *
+ * The count is compared with the threshold for 32 sensors at
+ * once, a bit (plane) at a time from the top: a sensor is over
+ * the threshold at the first bit where its count has a 1 and
+ * the threshold a 0, having been equal in all higher bits.
+ *
+ * @param w	word number (sensors 32*w ... 32*w+31)
+ * @return	whether or not that word of the S_fib plane changed
+ */
+bool SensorManager::fibCheck( int w ) {
+	int t = cfg->controls->maxTriggers();
+	if (t > FIB_MAX)
+		t = FIB_MAX;
+
+	sbits over = 0;
+	sbits equal = ~(sbits) 0;
+	for( int k = FIB_BITS - 1; k >= 0; k-- ) {
+		sbits c = plane(S_tokens + k)[w];
+		if (t & (1 << k)) {
+			equal &= c;
+		} else {
+			over |= equal & c;
+			equal &= ~c;
 		}
+	}
+	over |= equal;
+
+	sbits was = plane(S_fib)[w];
+	if (over == was)
+		return( false );
+	plane(S_fib)[w] = over;
+	tally( Z_fib, w, over & ~was, was & ~over );
+	return( true );
+}
+
+/**
+ * take a token from every bucket that has one (a vertical
+ * decrement, like the debounce counters), and if that brings
+ * any sensors below the threshold, have the next sample redo
+ * their relays and LEDs
+ */
+void SensorManager::fibLeak() {
+	leaking = false;
+	for( int w = 0; w < numWords; w++ ) {
+		sbits borrow = 0;
+		for( int k = 0; k < FIB_BITS; k++ )
+			borrow |= plane(S_tokens + k)[w];
+		if (borrow == 0)
+			continue;
+		for( int k = 0; k < FIB_BITS; k++ ) {
+			sbits c = plane(S_tokens + k)[w];
+			plane(S_tokens + k)[w] = c ^ borrow;
+			borrow &= ~c;
+			if (plane(S_tokens + k)[w])
+				leaking = true;
+		}
+		if (fibCheck( w ))
+			rescan = true;
+	}
+}
 #endif
-	    }
-	
-	    // figure out whether system and sensor/zone are armed
-	    unsigned char enabled = 0;	// is the zone enabled
-	    unsigned char fibrilating = 0;
-	    if (z >= 1 && z <= 8) {
-		enabled = zoneArmed & (1 << z);
+
+/**
+ * rebuild a zone-derived bit-plane (S_enabled)
+ *
+ * @param p	bit-plane to be rebuilt
+ * @param zones	bit mask of zones (1 << zone) whose sensors are set
+ */
+void SensorManager::zoneMask( int p, unsigned char zones ) {
+	for( int w = 0; w < numWords; w++ ) {
+		sbits m = 0;
+		for( int z = 1; z <= numZones; z++ )
+			if (zones & (1 << z))
+				m |= zoneBits(z)[w];
+		plane(p)[w] = m;
+	}
+}
+
+/**
+ * adjust the per-zone count of sensors in some state
+ *
+ * @param kind	which count (Z_*)
+ * @param w	word number (sensors 32*w ... 32*w+31)
+ * @param in	sensors that have entered that state
+ * @param out	sensors that have left it
+ */
+void SensorManager::tally( int kind, int w, sbits in, sbits out ) {
+	if ((in | out) == 0)
+		return;
+	unsigned char *c = &counts[kind * (numZones + 1)];
+	for( int z = 1; z <= numZones; z++ ) {
+		sbits m = zoneBits(z)[w];
+		c[z] += __builtin_popcountl( in & m ) - __builtin_popcountl( out & m );
+	}
+}
+
+/**
+ * recompute all of the per-zone counts from the bit-planes
+ */
+void SensorManager::recount() {
+	for( int i = 0; i < Z_COUNTS * (numZones + 1); i++ )
+		counts[i] = 0;
+	for( int w = 0; w < numWords; w++ ) {
+		sbits used = plane(S_used)[w];
+		tally( Z_sensors, w, used, 0 );
+		tally( Z_open, w, ~plane(S_status)[w] & used, 0 );
+		tally( Z_trig, w, plane(S_trigger)[w], 0 );
+		tally( Z_fib, w, plane(S_fib)[w], 0 );
+	}
+}
+
+/**
+ * @param zone	zone number (1 ...)
+ * @param s	where to put the summary
+ * @return	false if there is no such zone
+ */
+bool SensorManager::zoneSummary( int zone, ZoneSummary *s ) {
+	if (zone < 1 || zone > numZones)
+		return( false );
+	s->sensors = counts[Z_sensors * (numZones + 1) + zone];
+	s->open = counts[Z_open * (numZones + 1) + zone];
+	s->triggered = counts[Z_trig * (numZones + 1) + zone];
+	s->fibrillating = counts[Z_fib * (numZones + 1) + zone];
+	return( true );
+}
+
+/**
+ * @param zone	zone number (1 ...)
+ * @param after	previous open sensor (-1 to start)
+ * @return	next open sensor in the zone (-1 if none)
+ */
+int SensorManager::nextOpen( int zone, int after ) {
+	if (zone < 1 || zone > numZones || after < -1)
+		return( -1 );
+	for( int w = (after + 1) / S_BITS; w < numWords; w++ ) {
+		sbits m = ~plane(S_status)[w] & plane(S_used)[w] & zoneBits(zone)[w];
+		if (w == (after + 1) / S_BITS)
+			m &= ~(sbits) 0 << ((after + 1) % S_BITS);
+		if (m)
+			return( w * S_BITS + __builtin_ctzl( m ) );
+	}
+	return( -1 );
+}
+
 #ifdef DEFIB
-		fibrilating = (defib[z] >= cfg->controls->maxTriggers());
-#endif
-		if (enabled && !v && !fibrilating) {
-			zoneState |= 1 << z;
-			if (armed)
-				triggered(i, true);
-	    	}
-	    }
-
-	    // figure out what to do with the LEDs for this sensor
-	    enum ledState state = led_green;
-	    enum ledBlink blink = led_none;
-	    if (!v) {
-	    	state = (armed && enabled) ? led_red : led_yellow;
-		blink = fibrilating ? led_fast : led_none;
-	    } else if (triggered(i)) {
-	    	state = led_red;
-	    	blink = fibrilating ? led_fast : led_med;
-	    } else if (armed && enabled)
-	    	blink = led_slow;
-	    setLed( i, state, blink );
+/**
+ * @param sensor	sensor index
+ * @return		is it being ignored as fibrillating
+ */
+bool SensorManager::fibrillating( int sensor ) {
+	if (sensor < 0 || sensor >= numWords * S_BITS)
+		return( false );
+	return( (plane(S_fib)[sensor / S_BITS] >> (sensor % S_BITS)) & 1 );
+}
+#endif
+
+#ifdef ZONE_DELAYS
+/**
+ * start a zone's entry delay
+ *
+ * @param zone	zone number (1 ...)
+ * @param sensor	sensor that opened
+ */
+void SensorManager::enter( int zone, int sensor ) {
+	entering |= 1 << zone;
+	entrant[zone] = sensor;
+	timers->start( zone - 1, 1000L * cfg->sensors->entryDelay( zone ) );
+}
+
+/**
+ * end the entry and exit delays that have run out.  A zone
+ * whose entry delay runs out (without the system having been
+ * disarmed) trips its relay, and the sensor that started the
+ * countdown is latched as having triggered.
+ *
+ * @param now	current time (ms)
+ */
+void SensorManager::delays( unsigned long now ) {
+	for( int id = timers->expired( now ); id >= 0; id = timers->expired( now ) ) {
+		int z = id + 1;
+		unsigned char bit = 1 << z;
+		if (entering & bit) {
+			alarmed |= bit;
+			int i = entrant[z];
+			if (!getBit( S_trigger, i )) {
+				setBit( S_trigger, i, true );
+				tally( Z_trig, i / S_BITS, (sbits) 1 << (i % S_BITS), 0 );
+			}
+#ifdef	EVENT_LOG
+			if (events)
+				events->put( E_TRIGGER, i, z, 1, now );
+#endif
+		}
+		entering &= ~bit;
+		exiting &= ~bit;
+		rescan = true;
 	}
 }
 
+/**
+ * @param zone	zone number (1 ...)
+ * @return	ms left in its entry or exit delay (0 if none)
+ */
+unsigned long SensorManager::delayLeft( int zone ) {
+	if (zone < 1 || zone > numZones || !((entering | exiting) & (1 << zone)))
+		return( 0 );
+	return( timers->left( zone - 1 ) );
+}
+#endif
+
 /**
  * run through each of the four color phases 
  * (red, off, green off) for all of the LEDs, 
@@ -204,74 +775,77 @@ void SensorManager::sample() {
  *	at entry, all LED output shift states are zero
  *	because that is how we initialize them, 
  *	and that is how we leave them from here.
+ *
+ * With LED_ISR, the Timer2 interrupt runs the phases (see
+ * multiplex), and this only publishes new frames.
  */
 void SensorManager::update() {
 
-	long now = millis();	// time for blink management
+	unsigned long now = millis();	// time for blink management
+
+	// rebuild the red and green frames if anything has changed
+#ifdef PROFILE
+	unsigned long t = micros();
+#endif
+	if (blink( now ) || newLeds) {
+		compose();
+#ifdef PROFILE
+		unsigned long c = micros();
+		profile->add( p_frame, c - t );
+		t = c;
+#endif
+	}
+#ifndef LED_ISR
+	int r = outshifter->numRegs;
 	
 	// turn on any red LEDs that need to be turned on
-	int set = 0;
-	for( int i = 0; i < cfg->sensors->num_sensors; i++ ) {
-	    // if the sensor isn't configured ignore it
-
-	    // see if we are blinked off
-	    int b = blinkRate(i);
-	    if (b > 0 && ((now/b) & 1))
-		continue;
-
-	    // see if we should turn this red LED on
-	    if (hasRed(i)) {
-		outshifter->set(cfg->sensors->red(i), true);
-		set++;
-	    }
-	}
+	outshifter->load( &frames[0] );
 	outshifter->write();	// and latch those values
 	delayMicroseconds(cfg->leds->usRed());
 
 	// turn off all the red LEDs
-	if (set > 0) {
-	    for( int i = 0; i < cfg->sensors->num_sensors; i++ ) {
-		    outshifter->set(cfg->sensors->red(i), 0);
-	    }
+	if (litRed) {
+	    outshifter->load( &frames[2 * r] );
 	    outshifter->write();	// and latch those values
 	}
         if (cfg->leds->usOff() > 1)
 		delayMicroseconds(cfg->leds->usOff()/2);
 		
 	// turn on any green LEDs that need to be turned on
-	set = 0;
-	for( int i = 0; i < cfg->sensors->num_sensors; i++ ) {
-	    // see if we are blinked off
-	    int b = blinkRate(i);
-	    if (b > 0 && ((now/b) & 1))
-		continue;
-
-	    // see if we should turn this green LED on
-	    if (hasGreen(i)) {
-		outshifter->set(cfg->sensors->green(i), true);
-		set++;
-	    }
-	}
+	outshifter->load( &frames[r] );
 	outshifter->write();	// and latch those values
 	delayMicroseconds(cfg->leds->usGreen());
 
 	// turn off all the greens
-	if (set > 0) {
-	    for( int i = 0; i < cfg->sensors->num_sensors; i++ ) {
-	        outshifter->set(cfg->sensors->green(i), 0);
-	    }
+	if (litGreen) {
+	    outshifter->load( &frames[2 * r] );
 	    outshifter->write();	// and latch those values
 	}
 
         if (cfg->leds->usOff() > 0)
 		delayMicroseconds((1+cfg->leds->usOff())/2);
+#ifdef PROFILE
+	profile->add( p_duty, micros() - t );
+#endif
+#endif
 
 #ifdef DEFIB
-	unsigned s = now/1000;		// current (second) time
-	if (nextUpdate > s + cfg->controls->minInterval())
-		nextUpdate = s;		// correct for time wrap
+	// leak the token buckets (only while any have tokens)
+	if (leaking && (long) (now - nextLeak) >= 0) {
+		long interval = 1000L * cfg->controls->minInterval();
+		nextLeak += interval;
+		if ((long) (now - nextLeak) >= 0)
+			nextLeak = now + interval;	// fell a period behind
+		fibLeak();
+	}
+#endif
+#ifdef ZONE_DELAYS
+	delays( now );
 #endif
 	// zone updates
+#ifdef PROFILE
+	t = micros();
+#endif
 	for( int i = 1; i <= cfg->sensors->numZones(); i++ ) {
 		// flush out the state of each trigger relay
 		int p = cfg->sensors->zonePin(i);
@@ -281,23 +855,231 @@ void SensorManager::update() {
 			digitalWrite(p, t ? HIGH : LOW);
 #else
 			digitalWrite(p, t ? LOW : HIGH);
+#endif
+#ifdef LATENCY
+			if ((zoneState ^ relays) & edges & (1 << i))
+				latency.add( micros() - edgeTime[i] );
 #endif
 		}
-#ifdef DEFIB
-		// decrement defib counters at max allowable rate
-		if (s >= nextUpdate) {
-			if (defib[i] > 0)
-				defib[i]--;
+	}
+#ifdef PROFILE
+	profile->add( p_relay, micros() - t );
+#endif
+#ifdef LATENCY
+	/*
+	 * a relay change answers its zone's pending change, and once
+	 * everything has settled, changes that moved no relay are dropped
+	 */
+	edges &= ~(zoneState ^ relays);
+	if (touched == 0)
+		edges = 0;
+	relays = zoneState;
+#endif
+}
+
+/**
+ * advance the blink phases to the current time
+ *
+ * Each blink class flips between lit and dark every period,
+ * on multiples of that period.  Rather than dividing the time
+ * by each period on every update, we note when each will next
+ * flip, and (unless we fall a whole period behind) simply
+ * advance that by one period when it does.
+ *
+ * @param now	current time (ms)
+ * @return	whether any of the phases flipped
+ */
+bool SensorManager::blink( unsigned long now ) {
+	bool flipped = false;
+	for( int c = led_slow; c <= led_fast; c++ ) {
+		if ((long) (now - nextFlip[c]) < 0)
+			continue;
+
+		unsigned b = blinkRate( c );
+		if (b == 0)
+			continue;
+		if (now - nextFlip[c] < b) {
+			phases ^= 1 << c;
+			nextFlip[c] += b;
+		} else
+			blinkSync( c, now );
+		flipped = true;
+	}
+	return( flipped );
+}
+
+/**
+ * (re)compute the phase and next flip time of a blink class
+ *
+ * @param c	blink class (led_slow, led_med, led_fast)
+ * @param now	current time (ms)
+ */
+void SensorManager::blinkSync( int c, unsigned long now ) {
+	unsigned b = blinkRate( c );
+	if (b == 0) {			// never blinks
+		phases |= 1 << c;
+		return;
+	}
+	unsigned long q = now / b;
+	if (q & 1)
+		phases &= ~(1 << c);
+	else
+		phases |= 1 << c;
+	nextFlip[c] = (q + 1) * b;
+}
+
+/**
+ * @param i	sensor index
+ * @return	output index of its red (or green) LED
+ *
+ * (with STATIC_CONFIG, a byte from a table the compiler built,
+ *  rather than a range-checked call into the Config)
+ */
+inline unsigned SensorManager::redOut( int i ) {
+#ifdef STATIC_CONFIG
+	return( pgm_read_byte_near( &RedOutputs::v[i] ) );
+#else
+	return( (unsigned) cfg->sensors->red( i ) );
+#endif
+}
+
+inline unsigned SensorManager::greenOut( int i ) {
+#ifdef STATIC_CONFIG
+	return( pgm_read_byte_near( &GreenOutputs::v[i] ) );
+#else
+	return( (unsigned) cfg->sensors->green( i ) );
+#endif
+}
+
+/**
+ * rebuild the red and green output frames from the layers
+ * whose blink classes are lit (and the layers themselves
+ * if any LED has been changed since they were built)
+ */
+void SensorManager::compose() {
+	int r = outshifter->numRegs;
+
+	if (newLeds) {
+		for( int i = 0; i < 8 * r; i++ )
+			layers[i] = 0;
+#ifdef LED_BAM
+		for( int i = 0; i < 3 * r; i++ )
+			levels[i] = 0;
+		int lvRed = cfg->leds->lvRed();
+		int lvGreen = cfg->leds->lvGreen();
+		int lvHot = cfg->leds->lvHot();
+		if (dimmed) {
+			int night = cfg->leds->lvNight();
+			if (lvRed > night)
+				lvRed = night;
+			if (lvGreen > night)
+				lvGreen = night;
+			if (lvHot > night)
+				lvHot = night;
+		}
+#endif
+
+		sbits *red = plane(S_red);
+		sbits *green = plane(S_green);
+		for( int w = 0; w < numWords; w++ )
+		    for( sbits m = red[w] | green[w]; m != 0; m &= m - 1 ) {
+			sbits bit = m & -m;
+			int i = w * S_BITS + __builtin_ctzl( m );
+			int c = ((plane(S_b_lo)[w] & bit) ? 1 : 0) |
+				((plane(S_b_hi)[w] & bit) ? 2 : 0);
+			char *l = &layers[2 * c * r];
+			unsigned o, n = r * 8;
+			if ((red[w] & bit) && (o = redOut( i )) < n) {
+				l[o >> 3] |= 1 << (o & 7);
+#ifdef LED_BAM
+				int lv = (plane(S_trigger)[w] & bit) ? lvHot : lvRed;
+				for( int b = 0; b < 3; b++ )
+					if (lv & (1 << b))
+						levels[b * r + (o >> 3)] |= 1 << (o & 7);
+#endif
+			}
+			if ((green[w] & bit) && (o = greenOut( i )) < n) {
+				l[r + (o >> 3)] |= 1 << (o & 7);
+#ifdef LED_BAM
+				for( int b = 0; b < 3; b++ )
+					if (lvGreen & (1 << b))
+						levels[b * r + (o >> 3)] |= 1 << (o & 7);
+#endif
+			}
+		    }
+		newLeds = false;
+	}
+
+	char *f = frames;
+#ifdef LED_ISR
+	// build the set the interrupt is not showing, then swap them
+	if (shown == frames)
+		f = &frames[LED_FRAMES * r];
+#endif
+	char lit = 0;
+	for( int i = 0; i < r; i++ ) {
+		char red = 0;
+		char green = 0;
+		for( int c = led_none; c <= led_fast; c++ )
+			if (phases & (1 << c)) {
+				red |= layers[2 * c * r + i];
+				green |= layers[(2 * c + 1) * r + i];
+			}
+#ifdef LED_BAM
+		// each slice shows the LEDs with that bit of brightness
+		for( int b = 0; b < 3; b++ ) {
+			f[b * r + i] = red & levels[b * r + i];
+			f[(3 + b) * r + i] = green & levels[b * r + i];
 		}
+#else
+		f[i] = red;
+		f[r + i] = green;
 #endif
+		lit |= (red ? 1 : 0) | (green ? 2 : 0);
 	}
+	litRed = (lit & 1) != 0;
+	litGreen = (lit & 2) != 0;
+#ifdef LED_ISR
+	unsigned char oldSREG = SREG;
+	cli();
+	shown = f;
+	SREG = oldSREG;
+#endif
+}
 
-#ifdef DEFIB
-	// schedule the next counter update
-	if (s >= nextUpdate)
-		nextUpdate = s + cfg->controls->minInterval();
+#ifdef LED_ISR
+/**
+ * show the next LED multiplex phase (red, off, green, off),
+ * and set the timer for the duration of that phase.
+ *
+ * The output cascade skips redundant writes, so (e.g.) the
+ * off phase after an empty red frame costs nothing.
+ */
+void SensorManager::multiplex() {
+#ifdef PROFILE
+	unsigned long t = micros();
+#endif
+	ledPhase = (ledPhase + 1) & (LED_PHASES - 1);
+	outshifter->load( &shown[phaseFrame[ledPhase] * outshifter->numRegs] );
+	outshifter->write();
+	OCR2A = ledTicks[ledPhase];
+#ifdef PROFILE
+	profile->add( p_duty, micros() - t );
 #endif
 }
+#endif
+
+#ifdef LED_BAM
+/**
+ * limit all LEDs to the night brightness (or stop doing so)
+ *
+ * @param night	dim the LEDs
+ */
+void SensorManager::dim( bool night ) {
+	dimmed = night;
+	newLeds = true;
+}
+#endif
 
 /**
  * for the first few seconds after start up, we run a lamp test
@@ -324,16 +1106,9 @@ bool SensorManager::lampTest(bool force) {
 	unsigned long now = millis();
 	if (startTime == 0 || now < startTime) {
 		startTime = now;
-#ifdef DEBUG_EVT
-		if (debug > 1) {
-			// excuse: strings take up data space
-			logTime(now);
-			putchar('T');
-			putchar('E');
-			putchar('S');
-			putchar('T');
-			putchar('\n');
-		}
+#ifdef EVENT_LOG
+		if (events)
+			events->put( E_TEST, 255, 0, 1, now );
 #endif
 	}
 
@@ -341,15 +1116,9 @@ bool SensorManager::lampTest(bool force) {
 	int second = (now - startTime)/1000;
 	if (second > numTests) {
 		done = true;
-#ifdef DEBUG_EVT
-		if (debug > 1) {
-			// excuse: strings take up data space
-			logTime(now);
-			putchar('R');
-			putchar('U');
-			putchar('N');
-			putchar('\n');
-		}
+#ifdef EVENT_LOG
+		if (events)
+			events->put( E_TEST, 255, 0, 0, now );
 #endif
 		return false;
 	}
@@ -358,6 +1127,7 @@ bool SensorManager::lampTest(bool force) {
 	for ( int i = 0; i < cfg->sensors->num_sensors; i++ ) {
 		setLed(i, test[second%4], led_none );
 	}
+	rescan = true;	// sample must rebuild them afterwards
 	return( true );
 }
 
@@ -371,79 +1141,36 @@ bool SensorManager::lampTest(bool force) {
 void SensorManager::setLed( int sensor, enum ledState state, enum ledBlink blink ) {
 	if (sensor < 0 || sensor >= cfg->sensors->num_sensors)
 		return;
-	
-	// set the red/green indicators in the state byte
-	states[sensor] &= ~(S_red+S_green+S_b_hi+S_b_lo);
-	switch( state ) {
-	   case led_yellow:
-		states[sensor] |= S_green;
-		/* fallsthrough */
-	   case led_red:
-		states[sensor] |= S_red;
-		break;
-
-	   case led_green:
-		states[sensor] |= S_green;
-		break;
-	   default:
-		break;
-	}
 
-	// set the blink speed bits in the state byte
-	switch( blink ) {
-	   case led_fast:
-		states[sensor] |= S_b_hi;
-		/* fallsthrough */
-	   case led_slow:
-		states[sensor] |= S_b_lo;
-		break;
-
-	   case led_med:
-		states[sensor] |= S_b_hi;
-		break;
-		
-	   default:
-		break;
-	}
-}
+	// see if this changes anything
+	bool red = state == led_red || state == led_yellow;
+	bool green = state == led_green || state == led_yellow;
+	bool lo = blink == led_slow || blink == led_fast;
+	bool hi = blink == led_med || blink == led_fast;
+	if (getBit( S_red, sensor ) == red && getBit( S_green, sensor ) == green &&
+	    getBit( S_b_lo, sensor ) == lo && getBit( S_b_hi, sensor ) == hi)
+		return;
+	newLeds = true;
+	
+	// set the red/green indicator bits
+	setBit( S_red, sensor, red );
+	setBit( S_green, sensor, green );
 
-/**
- * @return should the red light be on
- */
-bool SensorManager::hasRed( int sensor ) {
-	if (sensor >=0 && sensor < cfg->sensors->num_sensors)
-		return( (states[sensor] & S_red) != 0 );
-	else
-		return false;
+	// set the blink speed bits
+	setBit( S_b_lo, sensor, lo );
+	setBit( S_b_hi, sensor, hi );
 }
 
 /**
- * @return should the green light be on
+ * @param c	blink class (led_slow, led_med, led_fast)
+ * @return	blink period (in ms) for that class
  */
-bool SensorManager::hasGreen( int sensor ) {
-	if (sensor >=0 && sensor < cfg->sensors->num_sensors)
-		return( (states[sensor] & S_green) != 0 );
-	else
-		return false;
-}
-	
-/**
- * @param sensor number
- * @return blink period (in ms) for that sensor
- */
-int SensorManager::blinkRate( int sensor ) {
-	if (sensor < 0 || sensor >= cfg->sensors->num_sensors)
-		return( 0 );
-
-	switch( states[sensor] & (S_b_hi+S_b_lo) ) {
-	    case S_b_hi+S_b_lo:
-		return cfg->leds->fast();
-	    case S_b_hi:
-		return cfg->leds->med();
-	    case S_b_lo:
-		return cfg->leds->slow();
-	    default:
-		return 0;
+int SensorManager::blinkRate( int c ) {
+	switch( c ) {
+	    case led_fast:	return cfg->leds->fast();
+	    case led_med:	return cfg->leds->med();
+	    case led_slow:	return cfg->leds->slow();
+	    default:		return 0;
 	}
 }
 
@@ -454,12 +1181,12 @@ int SensorManager::blinkRate( int sensor ) {
  * @param isTriggered
  */
 void SensorManager::triggered( int sensor, bool isTriggered ) {
-	if (sensor >= 0 && sensor < cfg->sensors->num_sensors)
-		if (isTriggered) {
-			states[sensor] |= S_trigger;
-		} else {
-			states[sensor] &= ~S_trigger;
-		}
+	if (sensor < 0 || sensor >= cfg->sensors->num_sensors ||
+	    getBit( S_trigger, sensor ) == isTriggered)
+		return;
+	sbits bit = (sbits) 1 << (sensor % S_BITS);
+	tally( Z_trig, sensor / S_BITS, isTriggered ? bit : 0, isTriggered ? 0 : bit );
+	setBit( S_trigger, sensor, isTriggered );
 }
 
 /**
@@ -467,10 +1194,7 @@ void SensorManager::triggered( int sensor, bool isTriggered ) {
  * @return the triggered status of a sensor
  */
 bool SensorManager::triggered( int sensor ) {
-	if (sensor >= 0 && sensor < cfg->sensors->num_sensors)
-		return( (states[sensor] & S_trigger) != 0 );
-	else
-		return( false );
+	return getBit( S_trigger, sensor );
 }
 
 /**
@@ -481,10 +1205,29 @@ void SensorManager::arm( int zone, bool armed ) {
 	if (zone < 0 || zone > 8)
 		return;
 	if (zone == 0 && armed) {	// system arm implies reset
-		for( int i = 0; i < cfg->sensors->num_sensors; i++ ) {
-			triggered(i, false);
-		}
+		for( int w = 0; w < numWords; w++ )
+			plane(S_trigger)[w] = 0;
+		for( int z = 1; z <= numZones; z++ )
+			counts[Z_trig * (numZones + 1) + z] = 0;
 	}
+#ifdef ZONE_DELAYS
+	// (re)arming or disarming the system ends all delays
+	unsigned char ended = (zone == 0) ? 0xfe : armed ? 0 : 1 << zone;
+	for( int z = 1; z <= numZones; z++ )
+		if (ended & (1 << z))
+			timers->stop( z - 1 );
+	exiting &= ~ended;
+	entering &= ~ended;
+	alarmed &= ~ended;
+
+	// and arming it starts the exit delays
+	if (zone == 0 && armed)
+		for( int z = 1; z <= numZones; z++ )
+			if (cfg->sensors->exitDelay( z ) > 0) {
+				exiting |= 1 << z;
+				timers->start( z - 1, 1000L * cfg->sensors->exitDelay( z ) );
+			}
+#endif
 
 	// update zoneArmed state accordingly
 	unsigned char mask = 1 << zone;
@@ -493,20 +1236,57 @@ void SensorManager::arm( int zone, bool armed ) {
 	else
 		zoneArmed &= ~mask;
 
-#ifdef	DEBUG_EVT
-	if (debug > 1) {	
-		// excuse: strings take up data space
-		logTime( millis() );
-		putchar(armed ? 'A' : 'd');
-		putchar(' ');
-		putchar('Z');
-		putchar('=');
-		putchar('0' + zone%10);
-		putchar('\n');
-	}
+	// and note which sensors are now in enabled zones
+	if (zone > 0)
+		zoneMask( S_enabled, zoneArmed );
+	rescan = true;
+
+#ifdef	EVENT_LOG
+	if (events)
+		events->put( E_ARM, 255, zone, armed, millis() );
 #endif
 }
 
+#ifdef JOURNAL
+/**
+ * pick up where we left off before we lost power: the zones
+ * that were armed, and the sensors that have triggered since
+ * the system was last armed.  This restores the state without
+ * recording any (new) events.
+ *
+ * @param journal	event history, newest first
+ */
+void SensorManager::restore( Journal *journal ) {
+	unsigned char known = 0;	// zones whose arm state we have found
+	unsigned char all = (2 << numZones) - 1;	// system (0) and each zone
+	bool since = true;		// still looking at events since the system arm
+	Event e;
+	for( int back = 0; journal->read( back, &e ); back++ ) {
+		if (e.what == E_ARM && e.zone <= numZones) {
+			unsigned char mask = 1 << e.zone;
+			if (!(known & mask) && e.state)
+				zoneArmed |= mask;
+			known |= mask;
+			if (e.zone == 0 && e.state)
+				since = false;
+		} else if (e.what == E_TRIGGER && since &&
+			   e.sensor < cfg->sensors->num_sensors) {
+			setBit( S_trigger, e.sensor, true );
+		}
+		if (known == all && !since)
+			break;
+	}
+
+	// triggers are only latched while the system is armed
+	if (!(zoneArmed & 1))
+		for( int w = 0; w < numWords; w++ )
+			plane(S_trigger)[w] = 0;
+	zoneMask( S_enabled, zoneArmed );
+	recount();
+	rescan = true;
+}
+#endif
+
 /*
  * note that each sensor has an official reported
  * state, and a last read state.  They are only
@@ -520,12 +1300,12 @@ void SensorManager::arm( int zone, bool armed ) {
  * @param isNormal
  */
 void SensorManager::status( int sensor, bool isNormal ) {
-	if (sensor < 0 || sensor >= cfg->sensors->num_sensors)
+	if (sensor < 0 || sensor >= cfg->sensors->num_sensors ||
+	    getBit( S_status, sensor ) == isNormal)
 		return;
-	if (isNormal)
-		states[sensor] |= S_status;
-	else
-		states[sensor] &= ~S_status;
+	sbits bit = (sbits) 1 << (sensor % S_BITS) & plane(S_used)[sensor / S_BITS];
+	tally( Z_open, sensor / S_BITS, isNormal ? 0 : bit, isNormal ? bit : 0 );
+	setBit( S_status, sensor, isNormal );
 }
 
 /**
@@ -533,10 +1313,7 @@ void SensorManager::status( int sensor, bool isNormal ) {
  * @return offical status of a sensor
  */
 bool SensorManager::status( int sensor ) {
-	if (sensor >= 0 && sensor < cfg->sensors->num_sensors)
-		return (states[sensor] & S_status) != 0;
-	else
-		return( false );
+	return getBit( S_status, sensor );
 }
 
 /**
@@ -546,12 +1323,7 @@ bool SensorManager::status( int sensor ) {
  * @param isNormal	current state
  */
 void SensorManager::previous( int sensor, bool isNormal ) {
-	if (sensor < 0 || sensor >= cfg->sensors->num_sensors)
-		return;
-	if (isNormal)
-		states[sensor] |= S_prev;
-	else
-		states[sensor] &= ~S_prev;
+	setBit( S_prev, sensor, isNormal );
 }
 
 /**
@@ -559,8 +1331,32 @@ void SensorManager::previous( int sensor, bool isNormal ) {
  * @return the last read status of a sensor
  */
 bool SensorManager::previous( int sensor ) {
-	if (sensor >= 0 && sensor < cfg->sensors->num_sensors)
-		return (states[sensor] & S_prev) != 0;
-	else
+	return getBit( S_prev, sensor );
+}
+
+/**
+ * @param p	bit-plane (S_*)
+ * @param sensor number
+ * @return	that sensor's bit in that plane
+ */
+bool SensorManager::getBit( int p, int sensor ) {
+	if (sensor < 0 || sensor >= cfg->sensors->num_sensors)
 		return( false );
+	sbits mask = (sbits) 1 << (sensor % S_BITS);
+	return( (plane(p)[sensor / S_BITS] & mask) != 0 );
+}
+
+/**
+ * @param p	bit-plane (S_*)
+ * @param sensor number
+ * @param value	new value for that sensor's bit in that plane
+ */
+void SensorManager::setBit( int p, int sensor, bool value ) {
+	if (sensor < 0 || sensor >= cfg->sensors->num_sensors)
+		return;
+	sbits mask = (sbits) 1 << (sensor % S_BITS);
+	if (value)
+		plane(p)[sensor / S_BITS] |= mask;
+	else
+		plane(p)[sensor / S_BITS] &= ~mask;
 }
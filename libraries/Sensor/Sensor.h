@@ -2,6 +2,17 @@
 #define sensor_h
 
 #include <Shiftreg.h>
+#include <Event.h>
+#include <Stats.h>
+#include <Timer.h>
+#ifdef STATIC_CONFIG
+#include <Tables.h>
+#endif
+
+class Journal;
+
+typedef unsigned long sbits;	// a bit for each of 32 sensors
+#define	S_BITS	32
 
 /**
  * a managed collection of sensors and their status indicators
@@ -15,9 +26,10 @@ class SensorManager {
      * @param config	object
      * @param input	InShifter for the sensors
      * @param output	OutShifter for the indicators
-     * @param zones	Zone manager for alarm relays
+     * @param log	ring for sensor/zone events (or 0 for none)
      */
-    SensorManager( Config *config, InShifter *input, OutShifter *output );
+    SensorManager( Config *config, InCascade *input, OutCascade *output,
+    		   EventLog *log = 0 );
 
     /**
      * read the current status of the input cascade
@@ -48,9 +60,107 @@ class SensorManager {
      */
     void arm( int zone, bool armed );
 
+#ifdef JOURNAL
+    /**
+     * restore the zone arms and triggers recorded in a journal
+     *
+     * @param journal	EEPROM event history
+     */
+    void restore( Journal *journal );
+#endif
+
     unsigned char zoneArmed;	// zone armed bits
     unsigned char zoneState;	// zone triggered bits
 
+    /**
+     * what the sensors in a zone are doing
+     */
+    struct ZoneSummary {
+	unsigned char sensors;		// sensors in the zone
+	unsigned char open;		// currently open
+	unsigned char triggered;	// latched as triggered
+	unsigned char fibrillating;	// ignored as fibrillating
+    };
+
+    /**
+     * @param zone	zone number (1 ...)
+     * @param s		where to put the summary
+     * @return		false if there is no such zone
+     */
+    bool zoneSummary( int zone, ZoneSummary *s );
+
+    /**
+     * iterate through the open sensors in a zone (e.g. to see
+     * what is keeping it from arming)
+     *
+     *	for( i = nextOpen( z, -1 ); i >= 0; i = nextOpen( z, i ) )
+     *
+     * @param zone	zone number (1 ...)
+     * @param after	previous open sensor (-1 to start)
+     * @return		next open sensor in the zone (-1 if none)
+     */
+    int nextOpen( int zone, int after );
+
+#ifdef DEFIB
+    /**
+     * @param sensor	sensor index
+     * @return		is it being ignored as fibrillating
+     */
+    bool fibrillating( int sensor );
+#endif
+
+#ifdef ZONE_DELAYS
+    /**
+     * @param zone	zone number (1 ...)
+     * @return		ms left in its entry or exit delay (0 if none)
+     */
+    unsigned long delayLeft( int zone );
+
+    unsigned char exiting;	// zones counting down their exit delays
+    unsigned char entering;	// zones counting down their entry delays
+    unsigned char alarmed;	// zones whose entry delays ran out
+#endif
+
+#ifdef LED_ISR
+    /**
+     * show the next LED multiplex phase (red, off, green, off)
+     * (called from the Timer2 compare match interrupt)
+     */
+    void multiplex();
+#endif
+
+#ifdef LED_BAM
+    /**
+     * limit all LEDs to the night brightness (or stop doing so)
+     *
+     * @param night	dim the LEDs
+     */
+    void dim( bool night );
+    bool dimmed;		// LEDs are limited to night brightness
+#endif
+
+    unsigned long scans;	// number of samples
+    unsigned long idle;		// samples that found nothing to do
+    unsigned touched;		// changed/debouncing sensors, last sample
+
+#ifdef LATENCY
+    Histogram latency;		// input change to relay change (us)
+    Histogram period;		// time between samples (us)
+#endif
+
+#ifdef PROFILE
+    enum loopPhase {	// profiled phases of the main loop
+	p_shift = 0,	// reading the input cascade
+	p_sample,	// debouncing, triggering and LED states
+	p_frame,	// building the LED frames
+	p_duty,		// a LED duty cycle (with LED_ISR, an interrupt)
+	p_relay,	// setting the relays
+	p_ctrl,		// reading the control inputs (ADC)
+	p_phases
+    };
+    Profile *profile;		// time spent in each phase (us)
+#endif
+
   private:
     /*
      * Memory is so precious on the Arduino that we:
@@ -61,28 +171,179 @@ class SensorManager {
      *     object but reference it from the (read only)
      *	   configuration object.
      * (c) encode everything we know about each sensor
-     *     in two bytes (one full of state/status bits)
+     *     in bits, kept as bit-planes (one bit per sensor
+     *     for each flag), so that sample() can process
+     *     32 sensors at a time with word operations.
      */
     Config     *cfg;		// configuration object
-    InShifter  *inshifter;	// input shift cascade for collection
-    OutShifter *outshifter;	// output shift cascade for collection
+    InCascade  *inshifter;	// input shift cascade for collection
+    OutCascade *outshifter;	// output shift cascade for collection
+    EventLog   *events;		// where we record what happens
+
+#ifdef STATIC_CONFIG
+    /*
+     * the sizes (and whether the inputs need to be looked up) are
+     * known at compile time, so the loops over words and zones and
+     * the plane addressing fold into constants
+     */
+    static const int numWords = CFG_WORDS;
+    static const bool identity = isIdentity();
+#else
+    int numWords;		// words in each bit-plane
+    bool identity;		// sensor i is input i (for all sensors)
+#endif
+    sbits *states;		// S_PLANES bit-planes of numWords each
+    bool rescan;		// sample must process all sensors
+
+    /*
+     * Each zone's sensors are a bit mask (built once), so zone
+     * questions are a few ANDs per word.  The number of sensors
+     * in each zone that are open, triggered and fibrillating are
+     * kept up to date as those bits change, so that a summary of
+     * a zone costs nothing.
+     */
+#ifdef STATIC_CONFIG
+    static const int numZones = NUM_ZONES;
+#else
+    int numZones;		// zones 1 ... numZones
+#endif
+    sbits *members;		// membership masks, numWords for each zone
+    unsigned char *counts;	// Z_COUNTS tallies for each zone
+#define	Z_sensors	0	// sensors in the zone
+#define	Z_open		1	// open sensors
+#define	Z_trig		2	// triggered sensors
+#define	Z_fib		3	// fibrillating sensors
+#define	Z_COUNTS	4
+
+    /**
+     * @param z	zone number (1 ... numZones)
+     * @return	first word of that zone's membership mask
+     */
+    sbits *zoneBits( int z ) { return &members[(z - 1) * numWords]; }
+
+    void tally( int kind, int w, sbits in, sbits out ); // adjust Z_* counts
+    void recount();		// recompute the Z_* counts from the planes
+
+#ifdef ZONE_DELAYS
+    /*
+     * Each zone's entry or exit countdown is a timer (zone z is
+     * timer z-1) on a wheel of DELAY_SLOTS ticks of DELAY_TICK ms.
+     * While a zone is counting down, its sensors trip nothing,
+     * and when an entry delay runs out, its relay stays tripped
+     * until the system is disarmed.
+     */
+#define	DELAY_TICK	250	// ms per timer tick
+#define	DELAY_SLOTS	16	// timer wheel slots
+    TimerWheel *timers;		// entry and exit delays
+    unsigned char entryZones;	// zones that have entry delays
+    unsigned char *entrant;	// sensor that started each entry delay
+    void enter( int zone, int sensor );	// start an entry delay
+    void delays( unsigned long now );	// end expired delays
+#endif
+
+#ifdef LATENCY
+    /*
+     * The first input change in a zone is timestamped (when it
+     * is read), and if the zone's relay changes before all of
+     * the sensors have settled, the time from one to the other
+     * goes into the latency histogram.
+     */
+    unsigned long readTime;	// micros() of the last input read
+    unsigned long *edgeTime;	// micros() of each zone's first change
+    unsigned char edges;	// zones with a pending change
+    unsigned char relays;	// zone relay states last written
+#endif
+
+    /*
+     * update() latches a red and a green frame every loop.  Those
+     * frames are cached, and only recomposed when an LED changes
+     * or a blink phase flips: a layer (output frame) is kept for
+     * each blink class and color, and the frames are the OR of
+     * the layers whose blink classes are in their lit phase.
+     */
+    char *layers;		// (blink class, color) output frames
+    char *frames;		// red, green, and dark output frames
+    bool newLeds;		// LED planes changed since layers built
+    bool litRed;		// red frame has any LEDs on
+    bool litGreen;		// green frame has any LEDs on
+    unsigned char phases;	// blink classes in their lit phase
+    unsigned long nextFlip[4];	// next phase flip time for each class
+#ifdef LED_BAM
+    char *levels;		// output bits lit in each BAM slice
+#define	LED_FRAMES	7	// red slices, green slices, dark
+#define	LED_PHASES	8	// red slices, dark, green slices, dark
+#else
+#define	LED_FRAMES	3	// red, green, dark
+#define	LED_PHASES	4	// red, dark, green, dark
+#endif
+#ifdef LED_ISR
+    char * volatile shown;	// frames the interrupt is showing
+    unsigned char ledPhase;	// current multiplex phase
+    unsigned char ledTicks[LED_PHASES];	// timer ticks in each phase
+#endif
 
-    unsigned char *debounce;	// debounce counts for each sensor
-    unsigned char *states;	// state bytes for each sensor
+    bool blink( unsigned long now );		// advance blink phases
+    void blinkSync( int c, unsigned long now );	// reset a blink phase
+    void compose();		// rebuild the cached frames
+    unsigned redOut( int i );	// output index of a sensor's red LED
+    unsigned greenOut( int i );	// output index of a sensor's green LED
 #ifdef DEFIB
-    unsigned char *defib;	// defibrillation counts for each zone
-    unsigned nextUpdate;	// time of next defib count update
+    unsigned long nextLeak;	// time of next token bucket leak
+    bool leaking;		// some bucket has tokens in it
+    void fibLeak();		// take a token from every bucket
+    bool fibCheck( int w );	// update S_fib from the token counts
 #endif
 
-// bits in the sensor state bytes
-#define S_b_lo	 	0x01	// low order bit of blink rate
-#define S_b_hi	 	0x02	// high order bit of blink rate
-#define S_red	 	0x04	// red light should be on
-#define S_green	 	0x08	// green light should be on
-#define S_trigger	0x10	// this sensor has been triggered
-#define S_status 	0x20	// currently reported state (1=normal)
-#define S_prev	 	0x40	// last read state (1=normal)
-#define S_sense	 	0x80	// 1 = high asserted
+// sensor state bit-planes
+#define S_b_lo	 	0	// low order bit of blink rate
+#define S_b_hi	 	1	// high order bit of blink rate
+#define S_red	 	2	// red light should be on
+#define S_green	 	3	// green light should be on
+#define S_trigger	4	// this sensor has been triggered
+#define S_status 	5	// currently reported state (1=normal)
+#define S_prev	 	6	// last read state (1=normal)
+#define S_sense	 	7	// 1 = high asserted
+#define S_used		8	// sensor has an input
+#define S_enabled	9	// sensor's zone is enabled
+#define S_fib		10	// sensor is fibrillating
+#define S_stable	11	// sensor is stable (this sample)
+#ifdef DEBOUNCE
+/*
+ * debounce counters are vertical: bit k of every sensor's count
+ * is in plane S_count+k, so that all of them can be decremented
+ * at once with a few word operations (a ripple borrow)
+ */
+#define	DB_BITS		3	// debounce count bits (max 7 samples)
+#define S_count		12	// first debounce count plane
+#define S_DB_END	(12 + DB_BITS)
+#else
+#define S_DB_END	12
+#endif
+#ifdef DEFIB
+/*
+ * defibrillation token buckets are vertical counters too: each
+ * transition adds a token to the sensor's bucket, and a token
+ * leaks out of every bucket each minInterval
+ */
+#define	FIB_BITS	5	// token count bits
+#define	FIB_MAX		((1 << FIB_BITS) - 1)	// a full bucket
+#define S_tokens	S_DB_END	// first token count plane
+#define S_PLANES	(S_DB_END + FIB_BITS)
+#else
+#define S_PLANES	S_DB_END
+#endif
+
+    /**
+     * @param p	bit-plane (S_*)
+     * @return	first word of that plane
+     */
+    sbits *plane( int p ) { return &states[p * numWords]; }
+
+    bool getBit( int p, int sensor );		// get a sensor's bit
+    void setBit( int p, int sensor, bool value ); // set a sensor's bit
+
+    sbits inputs( int w );	// input bits for 32 sensors
+    void zoneMask( int p, unsigned char zones ); // rebuild S_enabled
 
     /**
      * set the desired state of a LED
@@ -93,9 +354,7 @@ class SensorManager {
      */
     void setLed( int sensor, enum ledState state, enum ledBlink blink );
 
-    bool hasRed( int sensor );		// accessor function for red value
-    bool hasGreen( int sensor );	// accessor function for green value
-    int blinkRate( int sensor );	// accessor function for blink rate
+    int blinkRate( int c );	// blink period (ms) for a blink class
 
     /**
      * set the status of a sensor
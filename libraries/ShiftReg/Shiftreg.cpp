@@ -1,14 +1,27 @@
 #include <Config.h>
 #include <Arduino.h>
 #include <Shiftreg.h>
+#ifdef USE_SPI
+#include <SPI.h>
+
+/*
+ * SPI clock rates for each type of cascade.  The 74HC595 is
+ * good for well over the 8MHz maximum, but the (CMOS) 74C165
+ * needs a few hundred ns to propagate each shifted bit.
+ */
+#define	SPI_OUT_HZ	8000000
+#define	SPI_IN_HZ	1000000
+#endif
 
 /**
  * Create a new shift register cascade descriptor, 
  * initializing the basic parameters.
  */
-Shiftreg::Shiftreg( int regs, int dataP, int clockP, int latchP ) {
+Shiftreg::Shiftreg( int regs, int dataP, int clockP, int latchP, int m,
+			char *buffer ) {
 	numRegs = regs;
-	data = (char *) malloc( numRegs );	// ardunio can't new[]
+	mode = m;
+	data = buffer ? buffer : (char *) malloc( numRegs ); // ardunio can't new[]
 	for ( int i = 0; i < numRegs; i++ )
 		data[i] = 0;
 
@@ -20,20 +33,50 @@ Shiftreg::Shiftreg( int regs, int dataP, int clockP, int latchP ) {
 
 	latchPin = latchP;
 	pinMode( latchP, OUTPUT );
+
+#ifdef USE_SPI
+	// SPI owns the data and clock pins (and makes SS an output)
+	if (mode == SHIFT_SPI)
+		SPI.begin();
+#else
+	mode = SHIFT_SOFT;
+#endif
+
+#ifdef FAST_SHIFT
+	// the data pin port depends on direction, and is set by the subclass
+	clockPort = portOutputRegister( digitalPinToPort(clockP) );
+	clockMask = digitalPinToBitMask( clockP );
+	latchPort = portOutputRegister( digitalPinToPort(latchP) );
+	latchMask = digitalPinToBitMask( latchP );
+#endif
 };
 
 /**
  * initialize a shift register cascade for parallel output
  */
-OutShifter::OutShifter( int regs, int dataP, int clockP, int latchP ) :
-    Shiftreg( regs, dataP, clockP, latchP ) {
+OutShifter::OutShifter( int regs, int dataP, int clockP, int latchP, int m,
+			char *buffer, char *shadow ) :
+    Shiftreg( regs, dataP, clockP, latchP, m, buffer ) {
       pinMode( dataP, OUTPUT );
 
+      // we don't know what the registers hold until our first write
+      latched = shadow ? shadow : (char *) malloc( numRegs );
+      for ( int i = 0; i < numRegs; i++ )
+		latched[i] = 0;
+      numDirty = 0;
+      generation = 0;
+      writes = 0;
+      skips = 0;
+#ifdef FAST_SHIFT
+      dataPort = portOutputRegister( digitalPinToPort(dataP) );
+      dataMask = digitalPinToBitMask( dataP );
+#endif
+
 #ifdef	DEBUG_CFG
     extern int debug;
     if (debug) {
-	printf("O-shift: regs=%d, data=%d, clock=%d, latch=%d\n",
-		regs, dataP, clockP, latchP );
+	printf("O-shift: regs=%d, data=%d, clock=%d, latch=%d, mode=%d\n",
+		regs, dataP, clockP, latchP, mode );
     }
 #endif
 }
@@ -41,6 +84,11 @@ OutShifter::OutShifter( int regs, int dataP, int clockP, int latchP ) :
 /**
  * output the supplied data to the shift register cascade
  *
+ * SensorManager::update writes the cascade four times per loop,
+ * and most of those frames (e.g. no red LEDs on) are the same
+ * as the last one.  set() keeps track of how many bytes differ
+ * from what was last latched, so we can skip redundant writes.
+ *
  * @param data  pointer to data to be output
  * @param numBytes number of data bytes to be output
  *
@@ -51,6 +99,38 @@ OutShifter::OutShifter( int regs, int dataP, int clockP, int latchP ) :
  *	 shift cascade.
  */
 void OutShifter::write() {
+	if (numDirty == 0 && generation > 0) {
+		skips++;
+		return;
+	}
+	for ( int i = 0; i < numRegs; i++ )
+		latched[i] = data[i];
+	numDirty = 0;
+	generation++;
+	writes++;
+
+	transfer();
+}
+
+/**
+ * shift out and latch the contents of data[]
+ */
+void OutShifter::transfer() {
+#ifdef USE_SPI
+	if (mode == SHIFT_SPI) {
+		// burst the whole buffer out, same order as shiftOut
+		SPI.beginTransaction( SPISettings(SPI_OUT_HZ, MSBFIRST, SPI_MODE0) );
+		digitalWrite(latchPin, LOW);
+		for ( int i = numRegs - 1; i >= 0; i-- )
+			SPI.transfer( data[i] );
+		digitalWrite(latchPin, HIGH);
+		SPI.endTransaction();
+		return;
+	}
+#endif
+#ifdef FAST_SHIFT
+	portOut( data, numRegs );
+#else
 	// prepare to shift out the data
 	digitalWrite(clockPin, LOW);
 	digitalWrite(latchPin, LOW);
@@ -61,6 +141,7 @@ void OutShifter::write() {
 
 	// latch the data for output
 	digitalWrite(latchPin, HIGH);
+#endif
 }
 
 /**
@@ -73,26 +154,85 @@ void OutShifter::set( int bit, bool value ) {
 	if (bit < 0 || bit >= numRegs*8)
 		return;
 	
+	int reg = bit >> 3;
 	unsigned char mask = 1 << (bit & 7);
+	bool wasDirty = data[reg] != latched[reg];
 
 	if (value) 
-		data[bit>>3] |= mask;
+		data[reg] |= mask;
 	else
-		data[bit>>3] &= ~mask;
+		data[reg] &= ~mask;
+
+	// keep track of how many bytes differ from the latched frame
+	bool isDirty = data[reg] != latched[reg];
+	if (isDirty && !wasDirty)
+		numDirty++;
+	else if (wasDirty && !isDirty)
+		numDirty--;
+}
+
+/**
+ * replace the entire output frame
+ *
+ * @param frame	numRegs bytes of output data
+ */
+void OutShifter::load( const char *frame ) {
+	numDirty = 0;
+	for ( int i = 0; i < numRegs; i++ ) {
+		data[i] = frame[i];
+		if (data[i] != latched[i])
+			numDirty++;
+	}
+}
+
+/**
+ * @param reg number of register (0...)
+ * @return has that register changed since the last latch
+ */
+bool OutShifter::dirty( int reg ) {
+	if (reg < 0 || reg >= numRegs)
+		return( false );
+	return( data[reg] != latched[reg] );
 }
 
 /**
  * initialize a shift register cascade for parallel input
  */
-InShifter::InShifter( int regs, int dataP, int clockP, int latchP ) :
-    Shiftreg( regs, dataP, clockP, latchP ) { 
-	pinMode( dataP, INPUT );
+InShifter::InShifter( int regs, int dataP, int clockP, int latchP, int m,
+			int cascades, char *buffer, char *previous ) :
+    Shiftreg( regs, dataP, clockP, latchP, m, 
+    	(buffer || cascades <= 1) ? buffer : (char *) malloc( regs * cascades ) ) { 
+
+	// SPI has only one MISO, so it can only read one cascade
+	numCascades = (cascades < 1 || mode == SHIFT_SPI) ? 1 : cascades;
+	for ( int i = numRegs; i < numRegs * numCascades; i++ )
+		data[i] = 0;
+
+	// the previous snapshot, for change detection
+	prev = previous ? previous : (char *) malloc( numRegs * numCascades );
+	for ( int i = 0; i < numRegs * numCascades; i++ )
+		prev[i] = 0;
+	changes = false;
+	for ( int c = 0; c < numCascades; c++ )
+		pinMode( dataP + c, INPUT );
+#ifdef FAST_SHIFT
+	dataPort = portInputRegister( digitalPinToPort(dataP) );
+	dataMask = digitalPinToBitMask( dataP );
+
+	// we can only read them all at once if they are adjacent port bits
+	parallel = true;
+	for ( int c = 1; c < numCascades; c++ ) {
+		if (digitalPinToPort(dataP + c) != digitalPinToPort(dataP) ||
+		    digitalPinToBitMask(dataP + c) != (dataMask << c))
+			parallel = false;
+	}
+#endif
 
 #ifdef	DEBUG_CFG
 	extern int debug;
 	if (debug) {
-		printf("I-shift: regs=%d, data=%d, clock=%d, latch=%d\n",
-			regs, dataP, clockP, latchP );
+		printf("I-shift: regs=%d, data=%d, clock=%d, latch=%d, mode=%d, x%d\n",
+			regs, dataP, clockP, latchP, mode, numCascades );
 	}
 #endif
 }
@@ -132,7 +272,51 @@ int myShiftIn( int dataPin, int clockPin, int bitOrder ) {
  *	 in the first register of the cascade.
  */
 void InShifter::read() {
-        
+	int n = numRegs * numCascades;
+
+	// keep the previous snapshot for comparison
+	for ( int i = 0; i < n; i++ )
+		prev[i] = data[i];
+
+	fetch();
+
+	// note whether or not anything has changed
+	char delta = 0;
+	for ( int i = 0; i < n; i++ )
+		delta |= data[i] ^ prev[i];
+	changes = (delta != 0);
+}
+
+/**
+ * latch and shift in the contents of the cascade(s)
+ */
+void InShifter::fetch() {
+#ifdef USE_SPI
+	/*
+	 * The 74C165 puts its first bit on the output when it is
+	 * loaded, and shifts on the rising clock edge.  That is the 
+	 * bug that myShiftIn works around (shiftIn raises the clock 
+	 * before reading the first bit).  SPI mode 0 samples MISO on 
+	 * the rising edge, which is what we want.  The clock idles 
+	 * low, so the latch pulse happens with the clock low.
+	 */
+	if (mode == SHIFT_SPI) {
+		SPI.beginTransaction( SPISettings(SPI_IN_HZ, LSBFIRST, SPI_MODE0) );
+		digitalWrite(latchPin, LOW);
+		digitalWrite(latchPin, HIGH);
+		for ( int i = 0; i < numRegs; i++ )
+			data[i] = SPI.transfer( 0 );
+		SPI.endTransaction();
+		return;
+	}
+#endif
+	if (numCascades > 1) {
+		readParallel();
+		return;
+	}
+#ifdef FAST_SHIFT
+	portIn( data, numRegs );
+#else
 	// prepare to shift in the data
 	digitalWrite(clockPin, LOW);
 	digitalWrite(latchPin, LOW);
@@ -143,6 +327,76 @@ void InShifter::read() {
 	// clock in all of our data
 	for ( int i = 0; i < numRegs; i++ )
 		data[i] = myShiftIn( dataPin, clockPin, LSBFIRST );
+#endif
+}
+
+/**
+ * read several cascades that share the clock and latch, 
+ * taking one bit from each cascade on every clock edge.
+ *
+ * Cascade c's bytes follow cascade c-1's in data[], so bit b
+ * of cascade c is input index c*numRegs*8 + b, and get() (and
+ * SensorCfg::in() indices) need not know about cascades.
+ *
+ * When the data pins are adjacent bits of one port, each edge
+ * is a single port read, so reading N cascades costs little
+ * more than reading one.
+ */
+void InShifter::readParallel() {
+	for ( int i = 0; i < numRegs * numCascades; i++ )
+		data[i] = 0;
+
+#ifdef FAST_SHIFT
+	if (parallel) {
+		unsigned char oldSREG = SREG;
+		cli();
+
+		// latch the data for input
+		*clockPort &= ~clockMask;
+		*latchPort &= ~latchMask;
+		SETTLE();
+		*latchPort |= latchMask;
+		SETTLE();
+
+		// clock in all of the cascades at once
+		for ( int i = 0; i < numRegs; i++ ) {
+			for( unsigned char m = 0x01; m != 0; m <<= 1 ) {
+				*clockPort &= ~clockMask;
+				unsigned char bits = *dataPort;
+				*clockPort |= clockMask;
+
+				// demux the port bits into the cascade buffers
+				char *d = &data[i];
+				unsigned char b = dataMask;
+				for( int c = 0; c < numCascades; c++ ) {
+					if (bits & b)
+						*d |= m;
+					b <<= 1;
+					d += numRegs;
+				}
+			}
+		}
+		SREG = oldSREG;
+		return;
+	}
+#endif
+	// prepare to shift in the data
+	digitalWrite(clockPin, LOW);
+	digitalWrite(latchPin, LOW);
+
+	// latch the data for input
+	digitalWrite(latchPin, HIGH);
+
+	// clock in all of the cascades, one pin at a time
+	for ( int i = 0; i < numRegs; i++ ) {
+		for( unsigned char m = 0x01; m != 0; m <<= 1 ) {
+			digitalWrite(clockPin, LOW);
+			for( int c = 0; c < numCascades; c++ )
+				if (digitalRead(dataPin + c))
+					data[c * numRegs + i] |= m;
+			digitalWrite(clockPin, HIGH);
+		}
+	}
 }
 
 /**
@@ -151,9 +405,49 @@ void InShifter::read() {
  * @param bit number of desired bit (0...)
  */
 bool InShifter::get( int bit ) {
-	if (bit < 0 || bit >= numRegs*8)
+	if (bit < 0 || bit >= numRegs*numCascades*8)
 		return( 0 );
 	
 	unsigned char mask = 1 << (bit & 7);
 	return( (data[ bit >> 3 ] & mask) != 0 );
 }
+
+/**
+ * @return number of 32-bit words in the snapshot
+ */
+int InShifter::numWords() {
+	return( (numRegs * numCascades + 3) / 4 );
+}
+
+/**
+ * @param w number of the desired word (0...)
+ * @return inputs 32*w ... 32*w+31 (input 32*w in the low order bit)
+ */
+unsigned long InShifter::word( int w ) {
+	return bufWord( data, numRegs * numCascades, w * 4 );
+}
+
+/**
+ * @param w number of the desired word (0...)
+ * @return inputs 32*w ... 32*w+31 that changed in the last read
+ */
+unsigned long InShifter::changed( int w ) {
+	int n = numRegs * numCascades;
+	return bufWord( data, n, w * 4 ) ^ bufWord( prev, n, w * 4 );
+}
+
+/**
+ * @param w number of the desired 64-bit word (0...)
+ * @return inputs 64*w ... 64*w+63 (input 64*w in the low order bit)
+ */
+unsigned long long InShifter::word64( int w ) {
+	return ((unsigned long long) word( 2*w + 1 ) << 32) | word( 2*w );
+}
+
+/**
+ * @param w number of the desired 64-bit word (0...)
+ * @return inputs 64*w ... 64*w+63 that changed in the last read
+ */
+unsigned long long InShifter::changed64( int w ) {
+	return ((unsigned long long) changed( 2*w + 1 ) << 32) | changed( 2*w );
+}
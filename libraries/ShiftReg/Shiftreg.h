@@ -1,6 +1,23 @@
 #ifndef shiftreg_h
 #define shiftreg_h
 
+#include <Arduino.h>
+
+#ifdef FAST_SHIFT
+/*
+ * A direct port access is a couple of cycles, which is faster
+ * than the 74C165 can propagate a shifted bit to its output
+ * (a few hundred ns at 5V).  Burn a few cycles after each
+ * clock or latch edge to give the registers time to settle.
+ */
+#define	SETTLE()	__asm__ __volatile__ ("nop\n\tnop\n\tnop\n\tnop\n\tnop\n\tnop\n\t")
+
+// type of a port register (the host simulator overrides this)
+#ifndef PORT_REG
+#define	PORT_REG	volatile unsigned char
+#endif
+#endif
+
 /**
  * a ShiftReg is the interface to a cascade of input or output
  * shift registers (e.g. 74HC595, 74C165)
@@ -11,7 +28,22 @@ class Shiftreg {
     int  dataPin;	// data input/output pin
     int  clockPin;	// data clocking pin
     int  latchPin;	// data latching pin
+    char mode;		// SHIFT_SOFT or SHIFT_SPI
     char *data;		// input/output buffer
+
+#ifdef FAST_SHIFT
+    /*
+     * digitalWrite/digitalRead look up the port and bit for
+     * a pin on every call.  We do that once, at construction,
+     * and thereafter twiddle the port registers directly.
+     */
+    PORT_REG *dataPort;		// data in/out port register
+    PORT_REG *clockPort;	// clock out port register
+    PORT_REG *latchPort;	// latch out port register
+    unsigned char dataMask;		// data pin bit within port
+    unsigned char clockMask;		// clock pin bit within port
+    unsigned char latchMask;		// latch pin bit within port
+#endif
   
     /**
      * Create a new shift register cascade descriptor
@@ -20,8 +52,22 @@ class Shiftreg {
      * @param	data, pin number for data output
      * @param	clock, pin number for shift clock
      * @param	latch, pin number for data latch
+     * @param	mode, SHIFT_SOFT or SHIFT_SPI transport
+     * @param	buffer, static data buffer (or 0 to allocate one)
+     */
+    Shiftreg( int regs, int dataP, int clockP, int latchP, int mode,
+    		char *buffer );
+
+#ifdef FAST_SHIFT
+  protected:
+    /*
+     * port register transfers of a buffer, inline so that
+     * a cascade whose length is a compile time constant
+     * (StaticOutShifter, StaticInShifter) can fold the loops
      */
-    Shiftreg( int regs, int dataP, int clockP, int latchP );
+    inline void portOut( const char *buf, int n );
+    inline void portIn( char *buf, int n );
+#endif
 };
 
 /**
@@ -36,20 +82,65 @@ class OutShifter : public Shiftreg {
      * @param	data, pin number for data input/output
      * @param	clock, pin number for shift clock
      * @param	latch, pin number for data latch
+     * @param	mode, SHIFT_SOFT or SHIFT_SPI transport
+     * @param	buffer, static data buffer (or 0 to allocate one)
+     * @param	shadow, static latched buffer (or 0 to allocate one)
      */
-    OutShifter( int regs, int dataP, int clockP, int latchP );
+    OutShifter( int regs, int dataP, int clockP, int latchP,
+    		int mode = SHIFT_SOFT, char *buffer = 0, char *shadow = 0 );
     
     /**
      * set the specified bit to one or zero
      */
     void set( int bit, bool value );
 
+    /**
+     * replace the entire output frame
+     *
+     * @param frame	numRegs bytes of output data
+     */
+    void load( const char *frame );
+
     /**
      * output the supplied data to the shift register cascade
+     * (unless it is what the registers are already latching)
      */
     void write();
+
+    /**
+     * @param reg number of register (0...)
+     * @return has that register changed since the last latch
+     */
+    bool dirty( int reg );
+
+    unsigned generation;	// number of frames latched
+    unsigned long writes;	// write calls that were shifted out
+    unsigned long skips;	// write calls that were redundant
+
+  protected:
+    char *latched;		// what the registers currently hold
+    unsigned char numDirty;	// number of bytes != latched
+
+    void transfer();		// shift out and latch data[]
 };
 
+/**
+ * assemble four bytes (starting at byte first) of a buffer into a
+ * word (the first byte in the low order bits), with bytes past the
+ * end of the buffer as zero.  There is one bounds check per word,
+ * and none at all when len and first are compile-time constants.
+ */
+inline unsigned long bufWord( const char *buf, int len, int first ) {
+	const unsigned char *b = (const unsigned char *) &buf[first];
+	if (first + 4 <= len)
+		return( (unsigned long) b[0] | ((unsigned long) b[1] << 8) |
+			((unsigned long) b[2] << 16) | ((unsigned long) b[3] << 24) );
+	unsigned long w = 0;
+	for( int i = len - first - 1; i >= 0; i-- )
+		w = (w << 8) | b[i];
+	return( w );
+}
+
 /**
  * a cascade of 74C165 shift registers for parallel input
  */
@@ -62,8 +153,14 @@ class InShifter : public Shiftreg {
      * @param	data, pin number for data input
      * @param	clock, pin number for shift clock
      * @param	latch, pin number for data latch
+     * @param	mode, SHIFT_SOFT or SHIFT_SPI transport
+     * @param	cascades, number of cascades (data on dataP, dataP+1, ...)
+     * @param	buffer, static data buffer (or 0 to allocate one)
+     * @param	previous, static snapshot buffer (or 0 to allocate one)
      */
-    InShifter( int regs, int dataP, int clockP, int latchP );
+    InShifter( int regs, int dataP, int clockP, int latchP,
+    		int mode = SHIFT_SOFT, int cascades = 1, char *buffer = 0,
+		char *previous = 0 );
     
     /**
      * set the specified bit to one or zero
@@ -77,5 +174,252 @@ class InShifter : public Shiftreg {
      * @param numBytes number of data bytes to be read
      */
     void read( );
+
+    /*
+     * word-at-a-time access to the snapshot and to what changed
+     * since the previous read(), so that a consumer can find the
+     * changed inputs with a few word operations (and ctz loops)
+     * rather than calling get() for every input.
+     */
+    int numWords();			// number of 32-bit words
+    unsigned long word( int w );	// inputs 32*w ... 32*w+31
+    unsigned long changed( int w );	// which of those changed
+    unsigned long long word64( int w );	// inputs 64*w ... 64*w+63
+    unsigned long long changed64( int w );// which of those changed
+
+    int numCascades;	// parallel cascades sharing clock and latch
+    bool changes;	// did anything change in the last read
+
+  protected:
+    char *prev;			// snapshot before the last read
+    void fetch();		// latch and shift in data[]
+    void readParallel();	// read numCascades > 1 cascades
+#ifdef FAST_SHIFT
+    bool parallel;		// data pins are adjacent bits of one port
+#endif
 };
+
+#ifdef FAST_SHIFT
+/**
+ * clock a buffer out to the cascade (same order as shiftOut MSBFIRST)
+ *
+ * @param buf	data to be shifted out (last byte first)
+ * @param n	number of bytes
+ */
+inline void Shiftreg::portOut( const char *buf, int n ) {
+	// port updates are read-modify-write, so lock out interrupts
+	unsigned char oldSREG = SREG;
+	cli();
+
+	// prepare to shift out the data
+	*clockPort &= ~clockMask;
+	*latchPort &= ~latchMask;
+
+	// clock out all of our data
+	for ( int i = n - 1; i >= 0; i-- ) {
+		unsigned char b = buf[i];
+		for( unsigned char m = 0x80; m != 0; m >>= 1 ) {
+			if (b & m)
+				*dataPort |= dataMask;
+			else
+				*dataPort &= ~dataMask;
+			*clockPort |= clockMask;
+			*clockPort &= ~clockMask;
+		}
+	}
+
+	// latch the data for output
+	*latchPort |= latchMask;
+	SREG = oldSREG;
+}
+
+/**
+ * latch and clock in a cascade (same order as myShiftIn LSBFIRST)
+ *
+ * @param buf	buffer to receive the data (first register first)
+ * @param n	number of bytes
+ */
+inline void Shiftreg::portIn( char *buf, int n ) {
+	unsigned char oldSREG = SREG;
+	cli();
+
+	// prepare to shift in the data
+	*clockPort &= ~clockMask;
+	*latchPort &= ~latchMask;
+	SETTLE();
+
+	// latch the data for input
+	*latchPort |= latchMask;
+	SETTLE();
+
+	// clock in all of our data
+	for ( int i = 0; i < n; i++ ) {
+		unsigned char b = 0;
+		for( unsigned char m = 0x01; m != 0; m <<= 1 ) {
+			*clockPort &= ~clockMask;
+			if (*dataPort & dataMask)
+				b |= m;
+			*clockPort |= clockMask;
+			SETTLE();
+		}
+		buf[i] = b;
+	}
+	SREG = oldSREG;
+}
+#endif
+
+/**
+ * an output cascade whose size and pins are known at compile time.
+ *
+ * The buffers are static (no heap), and because the length is a
+ * constant, the bounds checks in set() and the loops in write()
+ * fold into straight-line code.  Calls through an OutShifter
+ * pointer still work (at run-time-configured speed).
+ */
+template <int REGS, int DATA, int CLOCK, int LATCH, int MODE = SHIFT_SOFT>
+class StaticOutShifter : public OutShifter {
+  public:
+    StaticOutShifter() : 
+    	OutShifter( REGS, DATA, CLOCK, LATCH, MODE, buf, shadow ) {}
+
+    /**
+     * set the specified bit to one or zero
+     */
+    inline void set( int bit, bool value ) {
+	if ((unsigned) bit >= REGS*8)
+		return;
+
+	int reg = bit >> 3;
+	unsigned char mask = 1 << (bit & 7);
+	bool wasDirty = buf[reg] != shadow[reg];
+	if (value) 
+		buf[reg] |= mask;
+	else
+		buf[reg] &= ~mask;
+	bool isDirty = buf[reg] != shadow[reg];
+	if (isDirty != wasDirty)
+		numDirty += isDirty ? 1 : -1;
+    }
+
+    /**
+     * replace the entire output frame
+     */
+    inline void load( const char *frame ) {
+	numDirty = 0;
+	for ( int i = 0; i < REGS; i++ ) {
+		buf[i] = frame[i];
+		if (buf[i] != shadow[i])
+			numDirty++;
+	}
+    }
+
+    /**
+     * output the data to the cascade (unless it is already latched)
+     */
+    inline void write() {
+	if (numDirty == 0 && generation > 0) {
+		skips++;
+		return;
+	}
+	for ( int i = 0; i < REGS; i++ )
+		shadow[i] = buf[i];
+	numDirty = 0;
+	generation++;
+	writes++;
+#ifdef FAST_SHIFT
+	if (MODE == SHIFT_SOFT) {
+		portOut( buf, REGS );
+		return;
+	}
+#endif
+	transfer();
+    }
+
+  private:
+    static char buf[REGS];	// output buffer
+    static char shadow[REGS];	// latched values
+};
+
+template <int REGS, int DATA, int CLOCK, int LATCH, int MODE>
+char StaticOutShifter<REGS, DATA, CLOCK, LATCH, MODE>::buf[REGS];
+template <int REGS, int DATA, int CLOCK, int LATCH, int MODE>
+char StaticOutShifter<REGS, DATA, CLOCK, LATCH, MODE>::shadow[REGS];
+
+/**
+ * an input cascade whose size and pins are known at compile time.
+ * (see StaticOutShifter)
+ */
+template <int REGS, int DATA, int CLOCK, int LATCH, int MODE = SHIFT_SOFT,
+	  int CASCADES = 1>
+class StaticInShifter : public InShifter {
+  public:
+    StaticInShifter() : 
+    	InShifter( REGS, DATA, CLOCK, LATCH, MODE, CASCADES, buf, old ) {}
+
+    /**
+     * return the value of a specified bit
+     */
+    inline bool get( int bit ) {
+	if ((unsigned) bit >= REGS*CASCADES*8)
+		return( 0 );
+	return( (buf[ bit >> 3 ] & (1 << (bit & 7))) != 0 );
+    }
+
+    /**
+     * @param w	number of the desired word (0...)
+     * @return	inputs 32*w ... 32*w+31 (input 32*w in the low order bit)
+     */
+    inline unsigned long word( int w ) {
+	return bufWord( buf, REGS*CASCADES, w * 4 );
+    }
+
+    /**
+     * @param w	number of the desired word (0...)
+     * @return	inputs 32*w ... 32*w+31 that changed in the last read
+     */
+    inline unsigned long changed( int w ) {
+	return bufWord( buf, REGS*CASCADES, w * 4 ) ^
+		bufWord( old, REGS*CASCADES, w * 4 );
+    }
+
+    /**
+     * read the contents of the shift register cascade
+     */
+    inline void read() {
+	for ( int i = 0; i < REGS*CASCADES; i++ )
+		old[i] = buf[i];
+#ifdef FAST_SHIFT
+	if (MODE == SHIFT_SOFT && CASCADES == 1)
+		portIn( buf, REGS );
+	else
+#endif
+		fetch();
+
+	char delta = 0;
+	for ( int i = 0; i < REGS*CASCADES; i++ )
+		delta |= buf[i] ^ old[i];
+	changes = (delta != 0);
+    }
+
+  private:
+    static char buf[REGS*CASCADES];	// input buffer
+    static char old[REGS*CASCADES];	// previous snapshot
+};
+
+template <int REGS, int DATA, int CLOCK, int LATCH, int MODE, int CASCADES>
+char StaticInShifter<REGS, DATA, CLOCK, LATCH, MODE, CASCADES>::buf[REGS*CASCADES];
+template <int REGS, int DATA, int CLOCK, int LATCH, int MODE, int CASCADES>
+char StaticInShifter<REGS, DATA, CLOCK, LATCH, MODE, CASCADES>::old[REGS*CASCADES];
+
+/*
+ * the cascade types that the rest of the program uses
+ */
+#ifdef STATIC_SHIFT
+typedef StaticInShifter<IN_REGS, IN_DATA, IN_CLOCK, IN_LATCH, IN_MODE,
+			IN_CASCADES> InCascade;
+typedef StaticOutShifter<OUT_REGS, OUT_DATA, OUT_CLOCK, OUT_LATCH, OUT_MODE> OutCascade;
+#else
+typedef InShifter InCascade;
+typedef OutShifter OutCascade;
+#endif
 #endif
@@ -0,0 +1,128 @@
+/*
+ * This module implements the compact histograms and profiles
+ * that we use to keep track of how long things take, without a
+ * logic analyzer or much RAM.
+ */
+#include <Arduino.h>
+#include <Stats.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+Histogram::Histogram() {
+	reset();
+}
+
+/**
+ * forget everything counted so far
+ */
+void Histogram::reset() {
+	count = 0;
+	max = 0;
+	scale = 0;
+	for( int b = 0; b < H_BUCKETS; b++ )
+		buckets[b] = 0;
+}
+
+/**
+ * @param v	value to be counted
+ */
+void Histogram::add( unsigned long v ) {
+	count++;
+	if (v > max)
+		max = v;
+
+	// once scaled, each count stands for 2^scale values
+	if ((count & ((1UL << scale) - 1)) != 0)
+		return;
+
+	// the bucket is the position of the highest one bit
+	int b = (v == 0) ? 0 : 8 * sizeof v - 1 - __builtin_clzl( v );
+	if (b >= H_BUCKETS)
+		b = H_BUCKETS - 1;
+	if (buckets[b] == 255 && scale < 31) {
+		for( int i = 0; i < H_BUCKETS; i++ )
+			buckets[i] >>= 1;
+		scale++;
+	}
+	if (buckets[b] < 255)
+		buckets[b]++;
+}
+
+/**
+ * print the non-empty buckets (lower bound: count)
+ *
+ * @param tag	character identifying the histogram
+ */
+void Histogram::print( char tag ) {
+	printf("%c n=%lu max=%lu x%lu\n", tag, count, max, 1UL << scale);
+	for( int b = 0; b < H_BUCKETS; b++ )
+		if (buckets[b])
+			printf(" %lu: %u\n", (b == 0) ? 0 : 1UL << b, buckets[b]);
+}
+
+/**
+ * @param n	number of phases
+ * @param t	a character identifying each phase
+ */
+Profile::Profile( int n, const char *t ) {
+	phases = n;
+	tags = t;
+	mins = (unsigned short *) malloc( n * sizeof (unsigned short) );
+	maxs = (unsigned short *) malloc( n * sizeof (unsigned short) );
+	totals = (unsigned long *) malloc( n * sizeof (unsigned long) );
+	counts = (unsigned long *) malloc( n * sizeof (unsigned long) );
+	reset();
+}
+
+/**
+ * forget everything counted so far
+ *
+ * (with interrupts off, since a phase may be added from an ISR)
+ */
+void Profile::reset() {
+	unsigned char oldSREG = SREG;
+	cli();
+	for( int p = 0; p < phases; p++ ) {
+		mins[p] = 0xffff;
+		maxs[p] = 0;
+		totals[p] = 0;
+		counts[p] = 0;
+	}
+	SREG = oldSREG;
+}
+
+/**
+ * @param phase	phase (0 ... phases-1)
+ * @param us	time it took (longer than 65ms counts as 65ms)
+ */
+void Profile::add( int phase, unsigned long us ) {
+	unsigned short t = (us > 0xffff) ? 0xffff : us;
+	if (t < mins[phase])
+		mins[phase] = t;
+	if (t > maxs[phase])
+		maxs[phase] = t;
+	totals[phase] += t;
+	counts[phase]++;
+}
+
+/**
+ * print a line for each phase that has run (tag, count, and
+ * minimum/average/maximum), and start over, so that the totals
+ * cover only the time since the last report (and do not wrap)
+ */
+void Profile::print() {
+	for( int p = 0; p < phases; p++ ) {
+		// copy the phase with interrupts off, so an ISR add is all or nothing
+		unsigned char oldSREG = SREG;
+		cli();
+		unsigned long n = counts[p];
+		unsigned long total = totals[p];
+		unsigned short lo = mins[p];
+		unsigned short hi = maxs[p];
+		SREG = oldSREG;
+		if (n)
+			printf("%c n=%lu min=%u avg=%lu max=%u\n", tags[p], n,
+				lo, total / n, hi);
+	}
+	reset();
+}
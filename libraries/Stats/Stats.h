@@ -0,0 +1,86 @@
+#ifndef STATS_H
+#define STATS_H
+
+#define	H_BUCKETS	24	// 1us ... 16s
+
+/**
+ * a compact histogram of (e.g. microsecond) durations
+ *
+ * Bucket b counts the values from 2^b to 2^(b+1)-1 (bucket 0
+ * also counts 0), so 24 bytes cover 1us to 16s, to within a
+ * factor of two.  When a bucket fills, all of them are halved,
+ * which keeps the shape of the distribution, and from then on
+ * only every 2^scale'th value is counted.
+ */
+class Histogram {
+
+  public:
+    Histogram();
+
+    /**
+     * @param v	value to be counted
+     */
+    void add( unsigned long v );
+
+    /**
+     * print the non-empty buckets (lower bound: count)
+     *
+     * @param tag	character identifying the histogram
+     */
+    void print( char tag );
+
+    /**
+     * forget everything counted so far
+     */
+    void reset();
+
+    unsigned long count;	// values added
+    unsigned long max;		// largest value added
+    unsigned char scale;	// bucket counts have been halved this often
+    unsigned char buckets[H_BUCKETS];	// (scaled) counts
+};
+
+/**
+ * minimum, average and maximum (e.g. microsecond) durations of
+ * each of a few named phases of a loop
+ *
+ * Each phase takes 12 bytes (16 bit minimum and maximum, 32 bit
+ * total and count), so an add is a few compares and two adds.
+ * A phase may be added from an interrupt handler (print and reset
+ * turn interrupts off while they read or clear the counts), but
+ * then its time is also in whatever phase it interrupted.
+ */
+class Profile {
+
+  public:
+    /**
+     * @param phases	number of phases
+     * @param tags	a character identifying each phase
+     */
+    Profile( int phases, const char *tags );
+
+    /**
+     * @param phase	phase (0 ... phases-1)
+     * @param us	time it took
+     */
+    void add( int phase, unsigned long us );
+
+    /**
+     * print a line for each phase that has run, and start over
+     */
+    void print();
+
+    /**
+     * forget everything counted so far
+     */
+    void reset();
+
+  private:
+    int phases;			// number of phases
+    const char *tags;		// character identifying each
+    unsigned short *mins;	// shortest time in each phase
+    unsigned short *maxs;	// longest time in each phase
+    unsigned long *totals;	// total time in each phase
+    unsigned long *counts;	// times each phase has run
+};
+#endif
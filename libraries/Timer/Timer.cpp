@@ -0,0 +1,152 @@
+/*
+ * This module keeps track of countdowns (like entry and exit
+ * delays) that run for seconds or minutes, without each of them
+ * doing its own millis() arithmetic on every loop.
+ */
+#include <Arduino.h>
+#include <Timer.h>
+
+/**
+ * @param timers	number of timers (ids 0 ... timers-1, < 254)
+ * @param n		wheel slots (rounded down to a power of two, < 254)
+ * @param t		duration of a tick (ms)
+ */
+TimerWheel::TimerWheel( int timers, int n, unsigned t ) {
+	slots = 1;
+	while( slots * 2 <= n && slots < 128 )
+		slots *= 2;
+	tick = (t > 0) ? t : 1;
+	cur = 0;
+	last = millis();
+	due = T_NONE;
+
+	heads = (unsigned char *) malloc( slots );
+	for( int s = 0; s < slots; s++ )
+		heads[s] = T_NONE;
+	next = (unsigned char *) malloc( timers );
+	prev = (unsigned char *) malloc( timers );
+	where = (unsigned char *) malloc( timers );
+	rounds = (unsigned short *) malloc( timers * sizeof (unsigned short) );
+	for( int i = 0; i < timers; i++ )
+		where[i] = T_NONE;
+}
+
+/**
+ * add a timer to the front of a list
+ *
+ * @param head	first timer in the list
+ * @param id	timer
+ * @param w	what list it is (slot or T_DUE)
+ */
+void TimerWheel::link( unsigned char *head, int id, unsigned char w ) {
+	next[id] = *head;
+	prev[id] = T_NONE;
+	if (*head != T_NONE)
+		prev[*head] = id;
+	*head = id;
+	where[id] = w;
+}
+
+/**
+ * take a timer off whatever list it is on
+ *
+ * @param id	timer
+ */
+void TimerWheel::unlink( int id ) {
+	unsigned char w = where[id];
+	if (w == T_NONE)
+		return;
+	if (prev[id] != T_NONE)
+		next[prev[id]] = next[id];
+	else if (w == T_DUE)
+		due = next[id];
+	else
+		heads[w] = next[id];
+	if (next[id] != T_NONE)
+		prev[next[id]] = prev[id];
+	where[id] = T_NONE;
+}
+
+/**
+ * (re)start a countdown
+ *
+ * A timer n ticks out goes in the slot n ticks ahead, to expire
+ * the ((n-1)/slots + 1)'th time that slot comes around.  The wheel
+ * is first brought up to the current time, and n counts from the
+ * start of the current tick, so a timer never expires early.
+ *
+ * @param id	timer
+ * @param ms	how long it should run (at least a tick)
+ */
+void TimerWheel::start( int id, unsigned long ms ) {
+	unlink( id );
+	unsigned long now = millis();
+	advance( now );
+	unsigned long n = (ms + (now - last) + tick - 1) / tick;
+	if (n == 0)
+		n = 1;
+	unsigned char s = (cur + n) & (slots - 1);
+	rounds[id] = (n - 1) / slots;
+	link( &heads[s], id, s );
+}
+
+/**
+ * @param id	timer to be stopped (if it is running)
+ */
+void TimerWheel::stop( int id ) {
+	unlink( id );
+}
+
+/**
+ * @param id	timer
+ * @return	ms until it expires (to within a tick), 0 if not running
+ */
+unsigned long TimerWheel::left( int id ) {
+	unsigned char w = where[id];
+	if (w == T_NONE || w == T_DUE)
+		return( 0 );
+	unsigned long n = ((w - cur - 1) & (slots - 1)) + 1;
+	return( (n + (unsigned long) rounds[id] * slots) * tick );
+}
+
+/**
+ * advance the wheel to the current time
+ *
+ * Each tick moves to the next slot: the timers there that are
+ * on their last trip around the wheel have expired (and go on
+ * the due list), and the rest have one less trip to go.
+ *
+ * @param now	millis()
+ */
+void TimerWheel::advance( unsigned long now ) {
+	while( now - last >= tick ) {
+		last += tick;
+		cur = (cur + 1) & (slots - 1);
+		unsigned char id = heads[cur];
+		while( id != T_NONE ) {
+			unsigned char n = next[id];
+			if (rounds[id] == 0) {
+				unlink( id );
+				link( &due, id, T_DUE );
+			} else
+				rounds[id]--;
+			id = n;
+		}
+	}
+}
+
+/**
+ * advance the wheel to the current time, and collect an
+ * expired timer (call repeatedly until there are none)
+ *
+ * @param now	millis()
+ * @return	id of an expired timer (-1 if none)
+ */
+int TimerWheel::expired( unsigned long now ) {
+	advance( now );
+	if (due == T_NONE)
+		return( -1 );
+	int id = due;
+	unlink( id );
+	return( id );
+}
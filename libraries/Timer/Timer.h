@@ -0,0 +1,83 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#define	T_NONE		0xff	// no timer (end of a list)
+#define	T_DUE		0xfe	// (where) expired, not yet collected
+
+/**
+ * a hashed timer wheel: any number of concurrent countdowns,
+ * at a cost of O(1) per tick (and per start or stop)
+ *
+ * Time advances in ticks, and the wheel has a (power of two)
+ * number of slots, one per tick.  A timer n ticks out goes in
+ * the slot n ticks ahead of the current one, with a count of
+ * the whole trips around the wheel it must wait out first, so
+ * each tick only looks at the (few) timers in one slot.  The
+ * timers in a slot are a doubly linked list of (byte) timer
+ * ids, so that stopping one is also O(1).
+ *
+ * Nothing ever compares two millis() values, only how far
+ * apart they are, so it all works across the 49 day wrap.
+ */
+class TimerWheel {
+
+  public:
+    /**
+     * @param timers	number of timers (ids 0 ... timers-1, < 254)
+     * @param slots	wheel slots (rounded down to a power of two, < 254)
+     * @param tick	duration of a tick (ms)
+     */
+    TimerWheel( int timers, int slots, unsigned tick );
+
+    /**
+     * (re)start a countdown
+     *
+     * @param id	timer
+     * @param ms	how long it should run (at least a tick)
+     */
+    void start( int id, unsigned long ms );
+
+    /**
+     * @param id	timer to be stopped (if it is running)
+     */
+    void stop( int id );
+
+    /**
+     * @param id	timer
+     * @return		is it counting down (or expired, but not collected)
+     */
+    bool running( int id ) { return( where[id] != T_NONE ); }
+
+    /**
+     * @param id	timer
+     * @return		ms until it expires (to within a tick), 0 if not running
+     */
+    unsigned long left( int id );
+
+    /**
+     * advance the wheel to the current time, and collect an
+     * expired timer (call repeatedly until there are none)
+     *
+     * @param now	millis()
+     * @return		id of an expired timer (-1 if none)
+     */
+    int expired( unsigned long now );
+
+  private:
+    unsigned char slots;	// number of wheel slots
+    unsigned char cur;		// slot of the current tick
+    unsigned tick;		// ms per tick
+    unsigned long last;		// millis() of the current tick
+
+    unsigned char *heads;	// first timer in each slot
+    unsigned char due;		// first expired timer
+    unsigned char *next;	// next timer in the same list
+    unsigned char *prev;	// previous timer in the same list
+    unsigned char *where;	// slot (or T_DUE/T_NONE) of each timer
+    unsigned short *rounds;	// trips around the wheel left for each
+
+    void link( unsigned char *head, int id, unsigned char w );
+    void unlink( int id );
+    void advance( unsigned long now );	// move the expired to the due list
+};
+#endif